@@ -20,6 +20,7 @@
 
 #include <Arduino.h>
 #include "PN5180.h"
+#include "PN5180Profile.h"
 #include "Debug.h"
 
 // PN5180 1-Byte Direct Commands
@@ -27,23 +28,61 @@
 #define PN5180_WRITE_REGISTER           (0x00)
 #define PN5180_WRITE_REGISTER_OR_MASK   (0x01)
 #define PN5180_WRITE_REGISTER_AND_MASK  (0x02)
+#define PN5180_WRITE_REGISTER_MULTIPLE  (0x03)
 #define PN5180_READ_REGISTER            (0x04)
 #define PN5180_WRITE_EEPROM             (0x06)
 #define PN5180_READ_EEPROM              (0x07)
 #define PN5180_SEND_DATA                (0x09)
 #define PN5180_READ_DATA                (0x0A)
 #define PN5180_SWITCH_MODE              (0x0B)
+#define PN5180_MFC_AUTHENTICATE         (0x0C)
 #define PN5180_LOAD_RF_CONFIG           (0x11)
 #define PN5180_RF_ON                    (0x16)
 #define PN5180_RF_OFF                   (0x17)
 
 uint8_t PN5180::readBuffer[508];
 
+PN5180ChipState PN5180::chipStates[PN5180_MAX_CHIPS];
+PN5180ChipState PN5180::uncachedState = { 0, false, 0xFF, 0xFF, { 0, 0, 0 }, 0, 0, 0, 0, NULL, false };
+
+// Registers, which are set by LOAD_RF_CONFIG and modified by the protocols.
+// Their loaded values are restored, instead of loading the RF configuration again.
+static const uint8_t rfShadowRegs[3] = { CRC_RX_CONFIG, TX_CONFIG, CRC_TX_CONFIG };
+#define RF_SHADOW_RX_MASK  (0x01)
+#define RF_SHADOW_TX_MASK  (0x06)
+
+// Registers of a profile, in the order of the PN5180_PROFILE_* flags
+#define PROFILE_NUM_REGS  (2)
+static const uint8_t profileRegs[PROFILE_NUM_REGS] = { CRC_TX_CONFIG, CRC_RX_CONFIG };
+#define PROFILE_MAX_WRITES  (9)
+
+// Max. number of elements in one WRITE_REGISTER_MULTIPLE frame
+#define REGISTER_WRITES_PER_FRAME  (PROFILE_MAX_WRITES)
+
 PN5180::PN5180(uint8_t SSpin, uint8_t BUSYpin, uint8_t RSTpin) {
   PN5180_NSS = SSpin;
   PN5180_BUSY = BUSYpin;
   PN5180_RST = RSTpin;
 
+  // share the RF configuration cache with the other instances of this chip
+  chip = &uncachedState;
+  uncachedRFOn = false;
+  PN5180ChipState *unused = NULL;
+  for (uint8_t i=0; i<PN5180_MAX_CHIPS; i++) {
+    if (chipStates[i].used && (chipStates[i].nss == SSpin)) {
+      chip = &chipStates[i];
+      break;
+    }
+    if (!chipStates[i].used && (NULL == unused)) unused = &chipStates[i];
+  }
+  if ((&uncachedState == chip) && (NULL != unused)) {
+    chip = unused;
+    chip->nss = SSpin;
+    chip->used = true;
+    chip->rfOn = false;
+    invalidateRFConfig();
+  }
+
   /*
    * 11.4.1 Physical Host Interface
    * The interface of the PN5180 to a host microcontroller is based on a SPI interface,
@@ -85,6 +124,8 @@ void PN5180::end() {
 bool PN5180::writeRegister(uint8_t reg, uint32_t value) {
   uint8_t *p = (uint8_t*)&value;
 
+  trackRegisterWrite(reg);
+
 #ifdef DEBUG
   PN5180DEBUG(F("Write Register 0x"));
   PN5180DEBUG(formatHex(reg));
@@ -119,6 +160,8 @@ bool PN5180::writeRegister(uint8_t reg, uint32_t value) {
 bool PN5180::writeRegisterWithOrMask(uint8_t reg, uint32_t mask) {
   uint8_t *p = (uint8_t*)&mask;
 
+  trackRegisterWrite(reg);
+
 #ifdef DEBUG
   PN5180DEBUG(F("Write Register 0x"));
   PN5180DEBUG(formatHex(reg));
@@ -149,6 +192,8 @@ bool PN5180::writeRegisterWithOrMask(uint8_t reg, uint32_t mask) {
 bool PN5180::writeRegisterWithAndMask(uint8_t reg, uint32_t mask) {
   uint8_t *p = (uint8_t*)&mask;
 
+  trackRegisterWrite(reg);
+
 #ifdef DEBUG
   PN5180DEBUG(F("Write Register 0x"));
   PN5180DEBUG(formatHex(reg));
@@ -168,6 +213,49 @@ bool PN5180::writeRegisterWithAndMask(uint8_t reg, uint32_t mask) {
   return true;
 }
 
+/*
+ * WRITE_REGISTER_MULTIPLE - 0x03
+ * This command is used to write multiple registers. The register addresses given in the
+ * array must exist, each element consists of address, action (write, OR mask, AND mask)
+ * and the 4 byte value or mask. The elements are executed in the order of the array.
+ * Longer lists are split into frames of REGISTER_WRITES_PER_FRAME elements.
+ */
+bool PN5180::writeRegisterMultiple(const PN5180RegisterWrite *writes, uint8_t num) {
+  uint8_t buf[1 + 6*REGISTER_WRITES_PER_FRAME];
+
+  while (num > 0) {
+    uint8_t n = (num > REGISTER_WRITES_PER_FRAME) ? REGISTER_WRITES_PER_FRAME : num;
+    buf[0] = PN5180_WRITE_REGISTER_MULTIPLE;
+    for (uint8_t i=0; i<n; i++) {
+      trackRegisterWrite(writes[i].reg);
+
+      PN5180DEBUG(F("Write Register 0x"));
+      PN5180DEBUG(formatHex(writes[i].reg));
+      PN5180DEBUG(F(", action="));
+      PN5180DEBUG(writes[i].action);
+      PN5180DEBUG(F(", value=0x"));
+      PN5180DEBUG(formatHex(writes[i].value));
+      PN5180DEBUG("\n");
+
+      uint8_t *p = &buf[1 + 6*i];
+      p[0] = writes[i].reg;
+      p[1] = writes[i].action;
+      for (int b=0; b<4; b++) {
+        p[2+b] = (uint8_t)(writes[i].value >> (8*b));  // LSB first
+      }
+    }
+
+    SPI.beginTransaction(PN5180_SPI_SETTINGS);
+    transceiveCommand(buf, 1 + 6*n);
+    SPI.endTransaction();
+
+    writes += n;
+    num -= n;
+  }
+
+  return true;
+}
+
 /*
  * READ_REGISTER - 0x04
  * This command is used to read the content of a configuration register. The content of the
@@ -284,26 +372,43 @@ bool PN5180::sendData(uint8_t *data, int len, uint8_t validBits) {
     return false;
   }
 
+  uint8_t buffer[len+2];
+  for (int i=0; i<len; i++) {
+    buffer[2+i] = data[i];
+  }
+
+  return sendDataFrame(buffer, len, validBits);
+}
+
+/*
+ * SEND_DATA - 0x09, with prepared SPI frame
+ * Same as sendData, but the data is already in place at frame[2..len+1], so no copy
+ * is needed. frame[0] and frame[1] are reserved for the command code and the number
+ * of valid bits. This allows a caller to prepare the next SPI frame in a second
+ * buffer, while the current one is still transmitted on the RF interface.
+ */
+bool PN5180::sendDataFrame(uint8_t *frame, int len, uint8_t validBits) {
+  if (len > 260) {
+    PN5180DEBUG(F("ERROR: sendData with more than 260 bytes is not supported!\n"));
+    return false;
+  }
+
 #ifdef DEBUG
   PN5180DEBUG(F("Send data (len="));
   PN5180DEBUG(len);
   PN5180DEBUG(F("):"));
   for (int i=0; i<len; i++) {
     PN5180DEBUG(" ");
-    PN5180DEBUG(formatHex(data[i]));
+    PN5180DEBUG(formatHex(frame[2+i]));
   }
   PN5180DEBUG("\n");
 #endif
 
-  uint8_t buffer[len+2];
-  buffer[0] = PN5180_SEND_DATA;
-  buffer[1] = validBits; // number of valid bits of last byte are transmitted (0 = all bits are transmitted)
-  for (int i=0; i<len; i++) {
-    buffer[2+i] = data[i];
-  }
+  frame[0] = PN5180_SEND_DATA;
+  frame[1] = validBits; // number of valid bits of last byte are transmitted (0 = all bits are transmitted)
 
-  writeRegisterWithAndMask(SYSTEM_CONFIG, 0xfffffff8);  // Idle/StopCom Command
-  writeRegisterWithOrMask(SYSTEM_CONFIG, 0x00000003);   // Transceive Command
+  writeRegisterWithAndMask(SYSTEM_CONFIG, ~SYSTEM_CONFIG_COMMAND_MASK);  // Idle/StopCom Command
+  writeRegisterWithOrMask(SYSTEM_CONFIG, SYSTEM_CONFIG_TRANSCEIVE);     // Transceive Command
   /*
    * Transceive command; initiates a transceive cycle.
    * Note: Depending on the value of the Initiator bit, a
@@ -320,7 +425,7 @@ bool PN5180::sendData(uint8_t *data, int len, uint8_t validBits) {
   }
 
   SPI.beginTransaction(PN5180_SPI_SETTINGS);
-  transceiveCommand(buffer, len+2);
+  transceiveCommand(frame, len+2);
   SPI.endTransaction();
 
   return true;
@@ -367,6 +472,70 @@ uint8_t * PN5180::readData(int len, uint8_t *buffer /* = NULL */) {
   return readBuffer;
 }
 
+/*
+ * SWITCH_MODE - 0x0B
+ * This command is used to switch the mode. Mode 0x01 is Low-Power Card Detection: the
+ * PN5180 stays in standby and switches the RF field on for LPCD_FIELD_ON_TIME after each
+ * period of the wakeup counter (in milliseconds). If the AGC value differs from the
+ * reference by more than LPCD_THRESHOLD, the LPCD_IRQ is set and the PN5180 returns to
+ * normal mode. Any SPI command terminates LPCD, so the host must wait for the IRQ pin.
+ */
+bool PN5180::switchToLPCD(uint16_t wakeupCounter) {
+  PN5180DEBUG(F("Switch to LPCD, wakeup counter="));
+  PN5180DEBUG(wakeupCounter);
+  PN5180DEBUG("\n");
+
+  clearIRQStatus(0xffffffff);
+  writeRegister(IRQ_ENABLE, LPCD_IRQ_STAT | GENERAL_ERROR_IRQ_STAT);
+
+  uint8_t cmd[4] = { PN5180_SWITCH_MODE, 0x01, (uint8_t)(wakeupCounter & 0xFF), (uint8_t)(wakeupCounter >> 8) };
+
+  SPI.beginTransaction(PN5180_SPI_SETTINGS);
+  transceiveCommand(cmd, 4);
+  SPI.endTransaction();
+
+  // the RF field is off after LPCD, the registers are used by the card detection
+  invalidateRFConfig();
+  setRFState(false);
+  return true;
+}
+
+/*
+ * MFC_AUTHENTICATE - 0x0C
+ * This command is used to perform a MIFARE Classic Authentication on an activated card.
+ * It takes the key, card UID and the key type to authenticate at a given card address. The
+ * response contains 1 byte indicating the authentication status:
+ * 0x00 - authentication successful, 0x01 - authentication failed (permission denied),
+ * 0x02 - timeout waiting for card response (e.g. card not in field).
+ * On success, the MFC_CRYPTO_ON bit of SYSTEM_CONFIG is set by the PN5180, all following
+ * frames are encrypted, until the bit is cleared by the host.
+ *
+ * keyType : 0x60 for key A, 0x61 for key B
+ * key : 6 bytes
+ * uid : 4 bytes, UID CL1 of single size UID, last 4 bytes of double size UID
+ */
+uint8_t PN5180::mifareAuthenticate(uint8_t blockno, uint8_t keyType, const uint8_t *key, const uint8_t *uid) {
+  PN5180DEBUG(F("MIFARE authenticate: block="));
+  PN5180DEBUG(blockno);
+  PN5180DEBUG(F(", keyType="));
+  PN5180DEBUG(formatHex(keyType));
+  PN5180DEBUG("\n");
+
+  uint8_t cmd[13];
+  cmd[0] = PN5180_MFC_AUTHENTICATE;
+  for (int i=0; i<6; i++) cmd[1+i] = key[i];
+  cmd[7] = keyType;
+  cmd[8] = blockno;
+  for (int i=0; i<4; i++) cmd[9+i] = uid[i];
+
+  uint8_t status = 0x02;
+  SPI.beginTransaction(PN5180_SPI_SETTINGS);
+  transceiveCommand(cmd, 13, &status, 1);
+  SPI.endTransaction();
+
+  return status;
+}
+
 /*
  * LOAD_RF_CONFIG - 0x11
  * Parameter 'Transmitter Configuration' must be in the range from 0x0 - 0x1C, inclusive. If
@@ -386,6 +555,19 @@ uint8_t * PN5180::readData(int len, uint8_t *buffer /* = NULL */) {
  *   0E              ISO 15693 ASK10   26        8E              ISO 15693   53
  */
 bool PN5180::loadRFConfig(uint8_t txConf, uint8_t rxConf) {
+  // the shared state of uncached chips may belong to another chip
+  if (&uncachedState == chip) invalidateRFConfig();
+
+  // skip the parts, which are already loaded
+  if (txConf == chip->rfConfigTx) txConf = 0xFF;
+  if (rxConf == chip->rfConfigRx) rxConf = 0xFF;
+  if ((0xFF == txConf) && (0xFF == rxConf)) {
+    chip->rfConfigHits++;
+    restoreRFRegisters();
+    return true;
+  }
+  chip->rfConfigMisses++;
+
   PN5180DEBUG(F("Load RF-Config: txConf="));
   PN5180DEBUG(formatHex(txConf));
   PN5180DEBUG(F(", rxConf="));
@@ -398,9 +580,187 @@ bool PN5180::loadRFConfig(uint8_t txConf, uint8_t rxConf) {
   transceiveCommand(cmd, 3);
   SPI.endTransaction();
 
+  if (0xFF != txConf) {
+    chip->rfConfigTx = txConf;
+    chip->rfShadowValid &= ~RF_SHADOW_TX_MASK;
+    chip->rfShadowDirty &= ~RF_SHADOW_TX_MASK;
+  }
+  if (0xFF != rxConf) {
+    chip->rfConfigRx = rxConf;
+    chip->rfShadowValid &= ~RF_SHADOW_RX_MASK;
+    chip->rfShadowDirty &= ~RF_SHADOW_RX_MASK;
+  }
+  restoreRFRegisters();
   return true;
 }
 
+/*
+ * Forget the loaded RF configuration of this chip, the next loadRFConfig sends LOAD_RF_CONFIG.
+ * The state of the RF field is kept.
+ */
+void PN5180::invalidateRFConfig() {
+  chip->rfConfigTx = 0xFF;
+  chip->rfConfigRx = 0xFF;
+  chip->rfShadowValid = 0;
+  chip->rfShadowDirty = 0;
+  chip->currentProfile = NULL;
+}
+
+static uint32_t profileClear(const PN5180Profile &profile, uint8_t i) {
+  return (0 == i) ? profile.crcTxClear : profile.crcRxClear;
+}
+
+static uint32_t profileSet(const PN5180Profile &profile, uint8_t i) {
+  return (0 == i) ? profile.crcTxSet : profile.crcRxSet;
+}
+
+// bit of the shadowed register in rfShadowRegs, 0 if it is not shadowed
+static uint8_t shadowBit(uint8_t reg) {
+  for (uint8_t i=0; i<3; i++) {
+    if (reg == rfShadowRegs[i]) return (1 << i);
+  }
+  return 0;
+}
+
+/*
+ * Switch to the register settings of a protocol with a minimal number of frames.
+ * LOAD_RF_CONFIG is only sent, if the RF configuration differs. Otherwise only the
+ * registers, whose values differ from the previous profile, and the registers modified
+ * since LOAD_RF_CONFIG are written, together with SYSTEM_CONFIG in one
+ * WRITE_REGISTER_MULTIPLE frame. A register, whose bits are modified by the profile,
+ * is restored first.
+ */
+bool PN5180::applyProfile(const PN5180Profile &profile) {
+  if (&uncachedState == chip) invalidateRFConfig();
+
+  const PN5180Profile *from = chip->currentProfile;
+  chip->currentProfile = NULL;
+
+  // shadowed registers, which are completely written by the profile, need not be restored
+  uint8_t profileShadow = 0;
+  for (uint8_t j=0; j<PROFILE_NUM_REGS; j++) {
+    if (0 == (profile.flags & (1 << j))) continue;
+    if (0xFFFFFFFF == profileClear(profile, j)) profileShadow |= shadowBit(profileRegs[j]);
+  }
+
+  if ((profile.rfTx != chip->rfConfigTx) || (profile.rfRx != chip->rfConfigRx)) {
+    chip->rfShadowDirty &= ~profileShadow;
+    if (!loadRFConfig(profile.rfTx, profile.rfRx)) {
+      return false;
+    }
+    from = NULL;  // the registers have the values of the RF configuration
+  }
+  else chip->rfConfigHits++;
+
+  // registers of the profile, which still have the values of the previous profile
+  uint8_t unchanged = 0;
+  uint8_t unchangedShadow = 0;
+  for (uint8_t j=0; j<PROFILE_NUM_REGS; j++) {
+    uint8_t flag = (1 << j);
+    if ((0 == (profile.flags & flag)) || (NULL == from) || (0 == (from->flags & flag))) continue;
+    if ((profileClear(*from, j) != profileClear(profile, j)) || (profileSet(*from, j) != profileSet(profile, j))) continue;
+    unchanged |= flag;
+    unchangedShadow |= shadowBit(profileRegs[j]);
+  }
+
+  PN5180RegisterWrite writes[PROFILE_MAX_WRITES];
+  uint8_t num = 0;
+
+  // restore the registers modified since LOAD_RF_CONFIG
+  uint8_t restored = chip->rfShadowDirty & ~(profileShadow | unchangedShadow);
+  for (uint8_t i=0; i<3; i++) {
+    if (0 == (restored & (1 << i))) continue;
+    writes[num++] = { rfShadowRegs[i], PN5180_REGISTER_WRITE, chip->rfShadow[i] };
+  }
+  uint8_t modified = 0;
+  for (uint8_t j=0; j<PROFILE_NUM_REGS; j++) {
+    uint8_t flag = (1 << j);
+    if ((0 == (profile.flags & flag)) || (unchanged & flag)) continue;
+    uint32_t clear = profileClear(profile, j);
+    uint32_t set = profileSet(profile, j);
+    if (0xFFFFFFFF == clear) {
+      writes[num++] = { profileRegs[j], PN5180_REGISTER_WRITE, set };
+    }
+    else {
+      if (0 != clear) writes[num++] = { profileRegs[j], PN5180_REGISTER_AND_MASK, ~clear };
+      if (0 != set) writes[num++] = { profileRegs[j], PN5180_REGISTER_OR_MASK, set };
+    }
+    modified |= shadowBit(profileRegs[j]);
+  }
+  if (0 != profile.systemConfigClear) {
+    writes[num++] = { SYSTEM_CONFIG, PN5180_REGISTER_AND_MASK, ~profile.systemConfigClear };
+  }
+  if (0 != profile.systemConfigSet) {
+    writes[num++] = { SYSTEM_CONFIG, PN5180_REGISTER_OR_MASK, profile.systemConfigSet };
+  }
+
+  if (num > 0) {
+    if (!writeRegisterMultiple(writes, num)) {
+      return false;
+    }
+    // the registers of the profile differ from the RF configuration, until restored
+    chip->rfShadowDirty = (chip->rfShadowDirty & ~restored) | modified;
+  }
+  chip->currentProfile = &profile;
+  return true;
+}
+
+/*
+ * Called before each register write. The first write to CRC_RX_CONFIG, TX_CONFIG or
+ * CRC_TX_CONFIG after LOAD_RF_CONFIG saves the loaded value, so it can be restored
+ * by the next loadRFConfig of the same configuration. A write to any other register
+ * of the RF configuration invalidates the cache. A write to a register set by the
+ * current profile forgets the profile.
+ */
+void PN5180::trackRegisterWrite(uint8_t reg) {
+  // a register of the current profile is changed, the next applyProfile writes it
+  if (NULL != chip->currentProfile) {
+    for (uint8_t j=0; j<PROFILE_NUM_REGS; j++) {
+      if ((reg == profileRegs[j]) && (chip->currentProfile->flags & (1 << j))) {
+        chip->currentProfile = NULL;
+        break;
+      }
+    }
+  }
+  for (uint8_t i=0; i<3; i++) {
+    if (reg != rfShadowRegs[i]) continue;
+    uint8_t bit = (1 << i);
+    uint8_t loaded = (bit & RF_SHADOW_TX_MASK) ? chip->rfConfigTx : chip->rfConfigRx;
+    if (0xFF == loaded) return;
+    if (0 == (chip->rfShadowValid & bit)) {
+      readRegister(reg, &chip->rfShadow[i]);
+      chip->rfShadowValid |= bit;
+    }
+    chip->rfShadowDirty |= bit;
+    return;
+  }
+  // TIMER2_CONFIG (0x10) up to RF_CONTROL_RX (0x22), except status registers
+  if ((reg >= 0x10) && (reg <= 0x22) && (reg != RX_STATUS) && (reg != RF_STATUS)) {
+    PN5180DEBUG(F("RF config cache invalidated by register 0x"));
+    PN5180DEBUG(formatHex(reg));
+    PN5180DEBUG("\n");
+    invalidateRFConfig();
+  }
+}
+
+/*
+ * The state of the RF field is shared by the instances of a chip in the table,
+ * otherwise it is kept per instance
+ */
+void PN5180::setRFState(bool on) {
+  if (&uncachedState == chip) uncachedRFOn = on;
+  else chip->rfOn = on;
+}
+
+void PN5180::restoreRFRegisters() {
+  for (uint8_t i=0; i<3; i++) {
+    uint8_t bit = (1 << i);
+    if (0 == (chip->rfShadowDirty & bit)) continue;
+    writeRegister(rfShadowRegs[i], chip->rfShadow[i]);
+    chip->rfShadowDirty &= ~bit;
+  }
+}
+
 /*
  * RF_ON - 0x16
  * This command is used to switch on the internal RF field. If enabled the TX_RFON_IRQ is
@@ -417,6 +777,7 @@ bool PN5180::setRF_on() {
 
   while (0 == (TX_RFON_IRQ_STAT & getIRQStatus())); // wait for RF field to set up
   clearIRQStatus(TX_RFON_IRQ_STAT);
+  setRFState(true);
   return true;
 }
 
@@ -433,6 +794,7 @@ bool PN5180::setRF_off() {
   SPI.beginTransaction(PN5180_SPI_SETTINGS);
   transceiveCommand(cmd, 2);
   SPI.endTransaction();
+  setRFState(false);
 
   while (0 == (TX_RFOFF_IRQ_STAT & getIRQStatus())); // wait for RF field to shut down
   clearIRQStatus(TX_RFOFF_IRQ_STAT);
@@ -480,7 +842,7 @@ status register contain information on the exception.
 bool PN5180::transceiveCommand(uint8_t *sendBuffer, size_t sendBufferLen, uint8_t *recvBuffer, size_t recvBufferLen) {
 #ifdef DEBUG
   PN5180DEBUG(F("Sending SPI frame: '"));
-  for (uint8_t i=0; i<sendBufferLen; i++) {
+  for (size_t i=0; i<sendBufferLen; i++) {
     if (i>0) PN5180DEBUG(" ");
     PN5180DEBUG(formatHex(sendBuffer[i]));
   }
@@ -492,7 +854,7 @@ bool PN5180::transceiveCommand(uint8_t *sendBuffer, size_t sendBufferLen, uint8_
   // 1.
   digitalWrite(PN5180_NSS, LOW); delay(2);
   // 2.
-  for (uint8_t i=0; i<sendBufferLen; i++) {
+  for (size_t i=0; i<sendBufferLen; i++) {
     SPI.transfer(sendBuffer[i]);
   }
   // 3.
@@ -510,7 +872,7 @@ bool PN5180::transceiveCommand(uint8_t *sendBuffer, size_t sendBufferLen, uint8_
   // 1.
   digitalWrite(PN5180_NSS, LOW); delay(2);
   // 2.
-  for (uint8_t i=0; i<recvBufferLen; i++) {
+  for (size_t i=0; i<recvBufferLen; i++) {
     recvBuffer[i] = SPI.transfer(0xff);
   }
   // 3.
@@ -522,7 +884,7 @@ bool PN5180::transceiveCommand(uint8_t *sendBuffer, size_t sendBufferLen, uint8_
 
 #ifdef DEBUG
   PN5180DEBUG(F("Received: "));
-  for (uint8_t i=0; i<recvBufferLen; i++) {
+  for (size_t i=0; i<recvBufferLen; i++) {
     if (i > 0) PN5180DEBUG(" ");
     PN5180DEBUG(formatHex(recvBuffer[i]));
   }
@@ -532,10 +894,32 @@ bool PN5180::transceiveCommand(uint8_t *sendBuffer, size_t sendBufferLen, uint8_
   return true;
 }
 
+/*
+ * Configure Low-Power Card Detection with self calibration, the reference is measured
+ * each time LPCD is entered, so no card may be in the field then.
+ * fieldOnTime: duration of the field for each detection, 62us + fieldOnTime * 8us
+ * threshold: min. difference of the AGC value to the reference for a wakeup
+ * The EEPROM is only written, if the configuration changes.
+ */
+bool PN5180::prepareLPCD(uint8_t fieldOnTime, uint8_t threshold) {
+  uint8_t config[3] = { fieldOnTime, threshold, LPCD_SELF_CALIBRATION };
+  uint8_t current[3];
+
+  if (!readEEprom(LPCD_FIELD_ON_TIME, current, 3)) {
+    return false;
+  }
+  if (0 == memcmp(config, current, 3)) {
+    return true;
+  }
+  return writeEEPROM(LPCD_FIELD_ON_TIME, config, 3);
+}
+
 /*
  * Reset NFC device
  */
 void PN5180::reset() {
+  invalidateRFConfig();
+  setRFState(false);
   digitalWrite(PN5180_RST, LOW);  // at least 10us required
   delay(10);
   digitalWrite(PN5180_RST, HIGH); // 2ms to ramp up required
@@ -32,17 +32,33 @@
 #define RX_WAIT_CONFIG      (0x11)
 #define CRC_RX_CONFIG       (0x12)
 #define RX_STATUS           (0x13)
+#define TX_CONFIG           (0x18)
 #define CRC_TX_CONFIG       (0x19)
 #define RF_STATUS           (0x1d)
 #define SYSTEM_STATUS       (0x24)
 #define TEMP_CONTROL        (0x25)
 
+// PN5180 SYSTEM_CONFIG
+#define SYSTEM_CONFIG_COMMAND_MASK  (0x00000007) // Idle/StopCom, if all bits are cleared
+#define SYSTEM_CONFIG_TRANSCEIVE    (0x00000003) // Transceive Command
+#define SYSTEM_CONFIG_MFC_CRYPTO_ON (1<<6)       // MIFARE Classic Crypto1 enabled
+
+// PN5180 CRC_RX_CONFIG, CRC_TX_CONFIG
+#define CRC_ENABLE                  (1<<0)
+
 // PN5180 EEPROM Addresses
 #define DIE_IDENTIFIER      (0x00)
 #define PRODUCT_VERSION     (0x10)
 #define FIRMWARE_VERSION    (0x12)
 #define EEPROM_VERSION      (0x14)
 #define IRQ_PIN_CONFIG      (0x1A)
+#define LPCD_REFERENCE_VALUE     (0x34)
+#define LPCD_FIELD_ON_TIME       (0x36)
+#define LPCD_THRESHOLD           (0x37)
+#define LPCD_REFVAL_GPO_CONTROL  (0x38)
+
+// LPCD_REFVAL_GPO_CONTROL: the reference value is measured when LPCD is entered
+#define LPCD_SELF_CALIBRATION    (0x01)
 
 enum PN5180TransceiveStat {
   PN5180_TS_Idle = 0,
@@ -64,6 +80,64 @@ enum PN5180TransceiveStat {
 #define TX_RFOFF_IRQ_STAT   (1<<8)  // RF Field OFF in PCD IRQ
 #define TX_RFON_IRQ_STAT    (1<<9)  // RF Field ON in PCD IRQ
 #define RX_SOF_DET_IRQ_STAT (1<<14) // RF SOF Detection IRQ
+#define GENERAL_ERROR_IRQ_STAT (1<<17) // General error IRQ
+#define LPCD_IRQ_STAT       (1<<19) // Low-Power Card Detection IRQ
+
+// PN5180 TRANSCEIVE_CONTROL
+#define RX_MULTIPLE_ENABLE  (1<<8)  // receive several frames into the RX buffer
+
+// Multiple frame reception: each frame is stored in a 32 byte slot of the RX buffer,
+// the last byte of the slot holds the status of the frame
+#define RX_MULTIPLE_SLOT_SIZE         (32)
+#define RX_MULTIPLE_LENGTH(status)    ((status) & 0x1f)
+#define RX_MULTIPLE_ERROR(status)     ((status) & 0xe0) // integrity, protocol error, collision
+
+// PN5180 RX_STATUS
+#define RX_NUM_BYTES_RECEIVED(rxStatus)  ((rxStatus) & 0x1ff)
+#define RX_NUM_FRAMES_RECEIVED(rxStatus) (((rxStatus) >> 9) & 0x0f)
+#define RX_NUM_LAST_BITS(rxStatus)       (((rxStatus) >> 13) & 0x07) // valid bits of last byte, 0 for 8
+#define RX_DATA_INTEGRITY_ERROR (1<<16) // Parity or CRC error
+#define RX_PROTOCOL_ERROR       (1<<17) // Protocol error, e.g. missing EOF
+#define RX_COLLISION_DETECTED   (1<<18) // Collision in received frame
+
+// Actions of WRITE_REGISTER_MULTIPLE
+#define PN5180_REGISTER_WRITE     (0x01)
+#define PN5180_REGISTER_OR_MASK   (0x02)
+#define PN5180_REGISTER_AND_MASK  (0x03)
+
+struct PN5180RegisterWrite {
+  uint8_t reg;
+  uint8_t action;     // PN5180_REGISTER_WRITE, _OR_MASK or _AND_MASK
+  uint32_t value;
+};
+
+struct PN5180Profile;
+
+// Number of PN5180 chips with own RF configuration cache, further chips are not cached
+#ifndef PN5180_MAX_CHIPS
+#if defined(__AVR__)
+#define PN5180_MAX_CHIPS  (2)
+#else
+#define PN5180_MAX_CHIPS  (4)
+#endif
+#endif
+
+/*
+ * RF configuration cache of one chip, identified by its NSS pin
+ */
+struct PN5180ChipState {
+  uint8_t nss;
+  bool used;
+  uint8_t rfConfigTx;               // loaded TX configuration, 0xFF if unknown
+  uint8_t rfConfigRx;               // loaded RX configuration, 0xFF if unknown
+  uint32_t rfShadow[3];             // loaded values of CRC_RX_CONFIG, TX_CONFIG, CRC_TX_CONFIG
+  uint8_t rfShadowValid;            // bit per register: value of rfShadow is known
+  uint8_t rfShadowDirty;            // bit per register: modified since LOAD_RF_CONFIG
+  uint32_t rfConfigHits;
+  uint32_t rfConfigMisses;
+  const PN5180Profile *currentProfile;  // registers still hold its values, or NULL
+  bool rfOn;                        // RF field switched on by setRF_on, not part of the cache
+};
 
 class PN5180 {
 private:
@@ -74,6 +148,14 @@ private:
   SPISettings PN5180_SPI_SETTINGS;
   static uint8_t readBuffer[508];
 
+  // RF configuration cache of the chip, shared by all instances with the same NSS pin
+  static PN5180ChipState chipStates[PN5180_MAX_CHIPS];
+  static PN5180ChipState uncachedState;  // used by all chips, if the table is full
+  PN5180ChipState *chip;
+  bool uncachedRFOn;                     // state of the RF field, if the chip is not in the table
+
+  void setRFState(bool on);
+
 public:
   PN5180(uint8_t SSpin, uint8_t BUSYpin, uint8_t RSTpin);
 
@@ -91,6 +173,9 @@ public:
   /* cmd 0x02 */
   bool writeRegisterWithAndMask(uint8_t addr, uint32_t mask);
 
+  /* cmd 0x03 */
+  bool writeRegisterMultiple(const PN5180RegisterWrite *writes, uint8_t num);
+
   /* cmd 0x04 */
   bool readRegister(uint8_t reg, uint32_t *value);
 
@@ -102,11 +187,23 @@ public:
 
   /* cmd 0x09 */
   bool sendData(uint8_t *data, int len, uint8_t validBits = 0);
+  bool sendDataFrame(uint8_t *frame, int len, uint8_t validBits = 0);
   /* cmd 0x0a */
   uint8_t * readData(int len, uint8_t *buffer = NULL);
 
+  /* cmd 0x0b */
+  bool switchToLPCD(uint16_t wakeupCounter);
+
+  /* cmd 0x0c */
+  uint8_t mifareAuthenticate(uint8_t blockno, uint8_t keyType, const uint8_t *key, const uint8_t *uid);
+
   /* cmd 0x11 */
   bool loadRFConfig(uint8_t txConf, uint8_t rxConf);
+  void invalidateRFConfig();
+  uint32_t getRFConfigHits() { return chip->rfConfigHits; }
+  uint32_t getRFConfigMisses() { return chip->rfConfigMisses; }
+  bool isRFOn() { return (&uncachedState == chip) ? uncachedRFOn : chip->rfOn; }
+  bool applyProfile(const PN5180Profile &profile);
 
   /* cmd 0x16 */
   bool setRF_on();
@@ -118,6 +215,7 @@ public:
    */
 public:
   void reset();
+  bool prepareLPCD(uint8_t fieldOnTime, uint8_t threshold);
 
   uint32_t getIRQStatus();
   bool clearIRQStatus(uint32_t irqMask);
@@ -128,6 +226,8 @@ public:
    * Private methods, called within an SPI transaction
    */
 private:
+  void trackRegisterWrite(uint8_t reg);
+  void restoreRFRegisters();
   bool transceiveCommand(uint8_t *sendBuffer, size_t sendBufferLen, uint8_t *recvBuffer = 0, size_t recvBufferLen = 0);
 
 };
@@ -0,0 +1,98 @@
+// NAME: PN5180CRC.cpp
+//
+// DESC: Software CRC-16 for frames, which are not covered by the CRC engine
+//       of the PN5180.
+//
+// Copyright (c) 2018 by Andreas Trappmann. All rights reserved.
+//
+// This file is part of the PN5180 library for the Arduino environment.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+#include <Arduino.h>
+#include "PN5180CRC.h"
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#define CRC_TABLE(n, i)  pgm_read_word(&table[n][i])
+#else
+#define CRC_TABLE(n, i)  (table[n][i])
+#endif
+
+// On AVR, the tables are kept in flash
+const uint16_t PN5180CRC::table[PN5180_CRC_SLICES][256] PROGMEM = {
+  PN5180_CRC_TABLE(0),
+#if (PN5180_CRC_SLICES == 4)
+  PN5180_CRC_TABLE(1),
+  PN5180_CRC_TABLE(2),
+  PN5180_CRC_TABLE(3),
+#endif
+};
+
+/*
+ * CRC-16 with reflected polynomial 0x8408 and the given preset, without final XOR.
+ * With slice-by-4, four bytes are processed per step: the first two bytes are
+ * combined with the CRC register, the CRC of the register is then taken from the
+ * tables for 3 and 2 following bytes, the other two bytes from the tables for 1
+ * and 0 following bytes.
+ */
+uint16_t PN5180CRC::crc16(const uint8_t *data, size_t len, uint16_t preset) {
+  uint16_t crc = preset;
+#if (PN5180_CRC_SLICES == 4)
+  while (len >= 4) {
+    crc ^= data[0] | (data[1] << 8);
+    crc = CRC_TABLE(3, crc & 0xFF) ^ CRC_TABLE(2, crc >> 8) ^
+          CRC_TABLE(1, data[2]) ^ CRC_TABLE(0, data[3]);
+    data += 4;
+    len -= 4;
+  }
+#endif
+  while (len-- > 0) {
+    crc = (crc >> 8) ^ CRC_TABLE(0, (crc ^ *data++) & 0xFF);
+  }
+  return crc;
+}
+
+uint16_t PN5180CRC::iso15693(const uint8_t *data, size_t len) {
+  return ~crc16(data, len, PN5180_CRC_ISO15693);
+}
+
+uint16_t PN5180CRC::iso14443a(const uint8_t *data, size_t len) {
+  return crc16(data, len, PN5180_CRC_ISO14443A);
+}
+
+uint16_t PN5180CRC::iClass(const uint8_t *data, size_t len) {
+  return crc16(data, len, PN5180_CRC_ICLASS);
+}
+
+static bool checkCRC(const uint8_t *frame, size_t len, uint16_t crc) {
+  return (frame[len-2] == (crc & 0xFF)) && (frame[len-1] == (crc >> 8));
+}
+
+bool PN5180CRC::checkISO15693(const uint8_t *frame, size_t len) {
+  if (len < 2) return false;
+  return checkCRC(frame, len, iso15693(frame, len-2));
+}
+
+bool PN5180CRC::checkISO14443A(const uint8_t *frame, size_t len) {
+  if (len < 2) return false;
+  return checkCRC(frame, len, iso14443a(frame, len-2));
+}
+
+bool PN5180CRC::checkiClass(const uint8_t *frame, size_t len) {
+  if (len < 2) return false;
+  return checkCRC(frame, len, iClass(frame, len-2));
+}
+
+void PN5180CRC::append(uint8_t *frame, size_t len, uint16_t crc) {
+  frame[len] = crc & 0xFF;
+  frame[len+1] = crc >> 8;
+}
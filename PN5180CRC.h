@@ -0,0 +1,91 @@
+// NAME: PN5180CRC.h
+//
+// DESC: Software CRC-16 for frames, which are not covered by the CRC engine
+//       of the PN5180.
+//
+// Copyright (c) 2018 by Andreas Trappmann. All rights reserved.
+//
+// This file is part of the PN5180 library for the Arduino environment.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+#ifndef PN5180CRC_H
+#define PN5180CRC_H
+
+#include <Arduino.h>
+
+/*
+ * ISO15693, ISO14443A and iClass use the same CRC-16 with polynomial 0x1021, processed
+ * LSB first (reflected polynomial 0x8408). They differ only in preset and final XOR:
+ *
+ *   ISO15693 (CRC-16/X-25): preset 0xFFFF, final XOR 0xFFFF
+ *   ISO14443A (CRC_A):      preset 0x6363, no final XOR
+ *   iClass:                 preset 0xE012 (0x4807 bit-reversed), no final XOR
+ *
+ * The CRC is transmitted LSB first after the data.
+ */
+#define PN5180_CRC_POLY         (0x8408)
+#define PN5180_CRC_ISO15693     (0xFFFF)
+#define PN5180_CRC_ISO14443A    (0x6363)
+#define PN5180_CRC_ICLASS       (0xE012)
+
+// Number of tables for slice-by-N, each table takes 512 bytes of flash
+#ifndef PN5180_CRC_SLICES
+#if defined(__AVR__)
+#define PN5180_CRC_SLICES  (1)
+#else
+#define PN5180_CRC_SLICES  (4)
+#endif
+#endif
+
+#if (PN5180_CRC_SLICES != 1) && (PN5180_CRC_SLICES != 4)
+#error PN5180_CRC_SLICES must be 1 or 4
+#endif
+
+/*
+ * Table entries are generated at compile time. C++11 constexpr functions consist of a
+ * single return statement, so the 8 shift steps are done by recursion.
+ */
+constexpr uint16_t pn5180CrcShift(uint16_t crc, uint8_t bits) {
+  return (bits == 0) ? crc : pn5180CrcShift((crc & 1) ? ((crc >> 1) ^ PN5180_CRC_POLY) : (crc >> 1), bits - 1);
+}
+
+// entry i of table n of slice-by-N: CRC of byte i, followed by n zero bytes
+constexpr uint16_t pn5180CrcEntry(uint8_t n, uint8_t i) {
+  return (n == 0) ? pn5180CrcShift(i, 8)
+                  : ((pn5180CrcEntry(n - 1, i) >> 8) ^ pn5180CrcShift(pn5180CrcEntry(n - 1, i) & 0xFF, 8));
+}
+
+#define PN5180_CRC_ROW4(n, i)    pn5180CrcEntry(n, i), pn5180CrcEntry(n, i+1), pn5180CrcEntry(n, i+2), pn5180CrcEntry(n, i+3)
+#define PN5180_CRC_ROW16(n, i)   PN5180_CRC_ROW4(n, i), PN5180_CRC_ROW4(n, i+4), PN5180_CRC_ROW4(n, i+8), PN5180_CRC_ROW4(n, i+12)
+#define PN5180_CRC_ROW64(n, i)   PN5180_CRC_ROW16(n, i), PN5180_CRC_ROW16(n, i+16), PN5180_CRC_ROW16(n, i+32), PN5180_CRC_ROW16(n, i+48)
+#define PN5180_CRC_TABLE(n)      { PN5180_CRC_ROW64(n, 0), PN5180_CRC_ROW64(n, 64), PN5180_CRC_ROW64(n, 128), PN5180_CRC_ROW64(n, 192) }
+
+class PN5180CRC {
+
+private:
+  static const uint16_t table[PN5180_CRC_SLICES][256];
+
+public:
+  static uint16_t crc16(const uint8_t *data, size_t len, uint16_t preset);
+  static uint16_t iso15693(const uint8_t *data, size_t len);
+  static uint16_t iso14443a(const uint8_t *data, size_t len);
+  static uint16_t iClass(const uint8_t *data, size_t len);
+
+  // check the CRC in the last 2 bytes of frame, len includes the CRC
+  static bool checkISO15693(const uint8_t *frame, size_t len);
+  static bool checkISO14443A(const uint8_t *frame, size_t len);
+  static bool checkiClass(const uint8_t *frame, size_t len);
+  // append the CRC after len bytes of frame
+  static void append(uint8_t *frame, size_t len, uint16_t crc);
+};
+
+#endif /* PN5180CRC_H */
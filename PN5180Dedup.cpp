@@ -0,0 +1,114 @@
+// NAME: PN5180Dedup.cpp
+//
+// DESC: Time-windowed suppression of repeated UID reports.
+//
+// Copyright (c) 2018 by Andreas Trappmann. All rights reserved.
+//
+// This file is part of the PN5180 library for the Arduino environment.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+//#define DEBUG 1
+
+#include <string.h>
+#include "PN5180Dedup.h"
+#if defined(ARDUINO)
+#include <Arduino.h>
+#include "PN5180Reader.h"
+#endif
+
+#define DEDUP_MASK  (PN5180_DEDUP_SIZE - 1)
+
+#define IS_USED(i)   (used[(i) >> 3] & (1 << ((i) & 7)))
+#define SET_USED(i)  (used[(i) >> 3] |= (1 << ((i) & 7)))
+
+PN5180Dedup::PN5180Dedup(uint32_t window) {
+  this->window = window;
+  clear();
+}
+
+/*
+ * Forget all UIDs and statistics
+ */
+void PN5180Dedup::clear() {
+  memset(used, 0, sizeof(used));
+  numReports = 0;
+  numSuppressed = 0;
+  numEvictions = 0;
+}
+
+// FNV-1a with 16 bit multiplications, which are cheap on AVR
+uint16_t PN5180Dedup::hash(const uint8_t *key) {
+  uint16_t h = 0x811C;
+  for (int i=0; i<8; i++) {
+    h = (h ^ key[i]) * 0x0193;
+  }
+  return h ^ (h >> 8);
+}
+
+/*
+ * uid: up to 8 bytes, the byte order of the protocol class
+ * now: timestamp, e.g. millis(), in the same unit as the window
+ */
+bool PN5180Dedup::isNew(const uint8_t *uid, uint8_t uidLength, uint32_t now) {
+  uint8_t key[8];
+  if (uidLength > 8) uidLength = 8;
+  memcpy(key, uid, uidLength);
+  memset(&key[uidLength], 0, 8 - uidLength);
+
+  uint16_t start = hash(key) & DEDUP_MASK;
+  int16_t freeSlot = -1;
+  int16_t oldest = -1;
+  for (uint16_t p=0; p<PN5180_DEDUP_PROBES; p++) {
+    uint16_t i = (start + p) & DEDUP_MASK;
+    if (!IS_USED(i)) {
+      if (freeSlot < 0) freeSlot = i;
+      continue;
+    }
+    uint32_t age = now - entries[i].reported;
+    if (0 == memcmp(entries[i].uid, key, 8)) {
+      if (age < window) {
+        numSuppressed++;
+        return false;
+      }
+      entries[i].reported = now;
+      numReports++;
+      return true;
+    }
+    if (age >= window) {
+      if (freeSlot < 0) freeSlot = i;
+    }
+    else if ((oldest < 0) || (age > (uint32_t)(now - entries[oldest].reported))) {
+      oldest = i;
+    }
+  }
+
+  // all UIDs are searched before inserting, so a UID is never stored twice
+  if (freeSlot < 0) {
+    freeSlot = oldest;
+    numEvictions++;
+  }
+  memcpy(entries[freeSlot].uid, key, 8);
+  entries[freeSlot].reported = now;
+  SET_USED(freeSlot);
+  numReports++;
+  return true;
+}
+
+#if defined(ARDUINO)
+bool PN5180Dedup::isNew(const PN5180Card *card, uint32_t now) {
+  return isNew(card->uid, card->uidLength, now);
+}
+
+bool PN5180Dedup::isNew(const PN5180Card *card) {
+  return isNew(card->uid, card->uidLength, millis());
+}
+#endif
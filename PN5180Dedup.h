@@ -0,0 +1,90 @@
+// NAME: PN5180Dedup.h
+//
+// DESC: Time-windowed suppression of repeated UID reports.
+//
+// Copyright (c) 2018 by Andreas Trappmann. All rights reserved.
+//
+// This file is part of the PN5180 library for the Arduino environment.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+#ifndef PN5180DEDUP_H
+#define PN5180DEDUP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Number of UIDs, must be a power of 2, 12 bytes RAM per UID
+#ifndef PN5180_DEDUP_SIZE
+#if defined(__AVR__)
+#define PN5180_DEDUP_SIZE  (16)
+#else
+#define PN5180_DEDUP_SIZE  (256)
+#endif
+#endif
+
+#if (PN5180_DEDUP_SIZE & (PN5180_DEDUP_SIZE - 1)) != 0
+#error PN5180_DEDUP_SIZE must be a power of 2
+#endif
+
+// Slots searched for a UID, starting at its hash slot
+#ifndef PN5180_DEDUP_PROBES
+#define PN5180_DEDUP_PROBES  ((PN5180_DEDUP_SIZE < 8) ? PN5180_DEDUP_SIZE : 8)
+#endif
+
+struct PN5180Card;
+
+/*
+ * Open addressing hash table of 8 byte UIDs with the time of their last report.
+ * A UID is reported again, once the window has elapsed since its last report.
+ * Expired entries are reused, if all probed slots are in use, the oldest entry is
+ * evicted, so the UID may be reported again early. This is rare, as long as less
+ * than half of the slots hold UIDs reported inside the window.
+ * Timestamps are passed by the caller, so it is usable without Arduino.
+ */
+class PN5180Dedup {
+
+private:
+  struct Entry {
+    uint8_t uid[8];       // shorter UIDs are padded with zeros
+    uint32_t reported;    // time of last report
+  };
+
+  Entry entries[PN5180_DEDUP_SIZE];
+  uint8_t used[(PN5180_DEDUP_SIZE + 7) / 8];
+  uint32_t window;
+  uint32_t numReports;
+  uint32_t numSuppressed;
+  uint32_t numEvictions;  // active entries replaced, since all probed slots were in use
+
+  static uint16_t hash(const uint8_t *key);
+
+public:
+  PN5180Dedup(uint32_t window = 1000);
+
+  // time, in which repeated reports are suppressed, in units of the timestamps
+  void setWindow(uint32_t window) { this->window = window; }
+  void clear();
+
+  // true, if the UID should be reported, false, if it was reported inside the window
+  bool isNew(const uint8_t *uid, uint8_t uidLength, uint32_t now);
+#if defined(ARDUINO)
+  // UIDs of 10 bytes are compared by their first 8 bytes
+  bool isNew(const PN5180Card *card, uint32_t now);
+  bool isNew(const PN5180Card *card);
+#endif
+
+  uint32_t getNumReports() { return numReports; }
+  uint32_t getNumSuppressed() { return numSuppressed; }
+  uint32_t getNumEvictions() { return numEvictions; }
+};
+
+#endif /* PN5180DEDUP_H */
@@ -0,0 +1,106 @@
+// NAME: PN5180EventQueue.cpp
+//
+// DESC: Lock-free single-producer single-consumer queue of tag events.
+//
+// Copyright (c) 2018 by Andreas Trappmann. All rights reserved.
+//
+// This file is part of the PN5180 library for the Arduino environment.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+//#define DEBUG 1
+
+#include <Arduino.h>
+#include "PN5180EventQueue.h"
+#include "Debug.h"
+
+/*
+ * head and tail run freely, the slot is the index modulo the queue size. The
+ * producer writes the event, before it publishes the new head with release
+ * semantics, the consumer reads head with acquire semantics, so it sees the
+ * complete event. The same applies to tail in the other direction.
+ */
+#if defined(__AVR__)
+// volatile does not order the other memory accesses, so a compiler barrier is added
+#define INDEX_LOAD(index)         (__extension__({ uint8_t v = (index); __asm__ __volatile__("" ::: "memory"); v; }))
+#define INDEX_STORE(index, value) do { __asm__ __volatile__("" ::: "memory"); (index) = (value); } while (0)
+#define INDEX_OWN(index)          (index)
+typedef uint8_t QueueCount;
+#else
+#define INDEX_LOAD(index)         ((index).load(std::memory_order_acquire))
+#define INDEX_STORE(index, value) ((index).store((value), std::memory_order_release))
+#define INDEX_OWN(index)          ((index).load(std::memory_order_relaxed))
+typedef uint32_t QueueCount;
+#endif
+
+#define QUEUE_MASK  (PN5180_EVENT_QUEUE_SIZE - 1)
+
+PN5180EventQueue::PN5180EventQueue() : head(0), tail(0) {
+  tailCache = 0;
+  numPushed = 0;
+  numOverflows = 0;
+}
+
+/*
+ * Called by the producer only. If the queue is full, the event is dropped and
+ * counted as overflow.
+ */
+bool PN5180EventQueue::push(const PN5180TagEvent &event) {
+  uint32_t h = INDEX_OWN(head);
+  if ((QueueCount)(h - tailCache) >= PN5180_EVENT_QUEUE_SIZE) {
+    tailCache = INDEX_LOAD(tail);
+    if ((QueueCount)(h - tailCache) >= PN5180_EVENT_QUEUE_SIZE) {
+      numOverflows++;
+      PN5180DEBUG(F("Event queue overflow\n"));
+      return false;
+    }
+  }
+  events[h & QUEUE_MASK] = event;
+  INDEX_STORE(head, h + 1);
+  numPushed++;
+  return true;
+}
+
+/*
+ * Event of a detected card with the current time, payload is cut to
+ * PN5180_EVENT_PAYLOAD_SIZE bytes
+ */
+bool PN5180EventQueue::push(const PN5180Card *card, const uint8_t *payload, uint8_t payloadLength) {
+  PN5180TagEvent event;
+  event.timestamp = millis();
+  event.protocol = card->protocol;
+  event.uidLength = card->uidLength;
+  for (int i=0; i<card->uidLength; i++) event.uid[i] = card->uid[i];
+  if (payloadLength > PN5180_EVENT_PAYLOAD_SIZE) payloadLength = PN5180_EVENT_PAYLOAD_SIZE;
+  event.payloadLength = payloadLength;
+  for (int i=0; i<payloadLength; i++) event.payload[i] = payload[i];
+  return push(event);
+}
+
+/*
+ * Called by the consumer only.
+ *
+ * return value: false, if the queue is empty
+ */
+bool PN5180EventQueue::pop(PN5180TagEvent *event) {
+  uint32_t t = INDEX_OWN(tail);
+  if ((QueueCount)(INDEX_LOAD(head) - t) == 0) {
+    return false;
+  }
+  *event = events[t & QUEUE_MASK];
+  INDEX_STORE(tail, t + 1);
+  return true;
+}
+
+// Number of events in the queue, as seen by the consumer
+uint16_t PN5180EventQueue::available() {
+  return (QueueCount)(INDEX_LOAD(head) - INDEX_OWN(tail));
+}
@@ -0,0 +1,106 @@
+// NAME: PN5180EventQueue.h
+//
+// DESC: Lock-free single-producer single-consumer queue of tag events.
+//
+// Copyright (c) 2018 by Andreas Trappmann. All rights reserved.
+//
+// This file is part of the PN5180 library for the Arduino environment.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+#ifndef PN5180EVENTQUEUE_H
+#define PN5180EVENTQUEUE_H
+
+#include "PN5180Reader.h"
+#if !defined(__AVR__)
+#include <atomic>
+#endif
+
+// Number of events, must be a power of 2, max. 128 on AVR
+#ifndef PN5180_EVENT_QUEUE_SIZE
+#if defined(__AVR__)
+#define PN5180_EVENT_QUEUE_SIZE  (8)
+#else
+#define PN5180_EVENT_QUEUE_SIZE  (32)
+#endif
+#endif
+
+#if (PN5180_EVENT_QUEUE_SIZE & (PN5180_EVENT_QUEUE_SIZE - 1)) != 0
+#error PN5180_EVENT_QUEUE_SIZE must be a power of 2
+#endif
+#if defined(__AVR__) && (PN5180_EVENT_QUEUE_SIZE > 128)
+#error PN5180_EVENT_QUEUE_SIZE must not exceed 128 on AVR
+#endif
+
+// Max. bytes of payload per event, e.g. the first block of the tag
+#ifndef PN5180_EVENT_PAYLOAD_SIZE
+#if defined(__AVR__)
+#define PN5180_EVENT_PAYLOAD_SIZE  (4)
+#else
+#define PN5180_EVENT_PAYLOAD_SIZE  (16)
+#endif
+#endif
+
+// The indices of producer and consumer are kept on separate cache lines
+#ifndef PN5180_CACHE_LINE
+#if defined(__AVR__)
+#define PN5180_CACHE_LINE  (1)
+#else
+#define PN5180_CACHE_LINE  (64)
+#endif
+#endif
+
+struct PN5180TagEvent {
+  uint32_t timestamp;         // millis() of detection
+  PN5180Protocol protocol;
+  uint8_t uidLength;
+  uint8_t uid[10];
+  uint8_t payloadLength;
+  uint8_t payload[PN5180_EVENT_PAYLOAD_SIZE];
+};
+
+#if defined(__AVR__)
+typedef volatile uint8_t PN5180QueueIndex;   // single byte loads and stores are atomic
+#else
+typedef std::atomic<uint32_t> PN5180QueueIndex;
+#endif
+
+/*
+ * One task or interrupt pushes, one other task pops, without locks. Declare the
+ * queue as global or static variable, so the cache line alignment is kept.
+ */
+class PN5180EventQueue {
+
+private:
+  // written by the producer, only head is read by the consumer
+  alignas(PN5180_CACHE_LINE) PN5180QueueIndex head;
+  uint32_t tailCache;         // last read value of tail, avoids reading the consumer's line
+  uint32_t numPushed;
+  uint32_t numOverflows;      // events dropped, since the queue was full
+  // written by the consumer
+  alignas(PN5180_CACHE_LINE) PN5180QueueIndex tail;
+  alignas(PN5180_CACHE_LINE) PN5180TagEvent events[PN5180_EVENT_QUEUE_SIZE];
+
+public:
+  PN5180EventQueue();
+
+  // producer
+  bool push(const PN5180TagEvent &event);
+  bool push(const PN5180Card *card, const uint8_t *payload = NULL, uint8_t payloadLength = 0);
+  uint32_t getNumPushed() { return numPushed; }
+  uint32_t getNumOverflows() { return numOverflows; }
+
+  // consumer
+  bool pop(PN5180TagEvent *event);
+  uint16_t available();
+};
+
+#endif /* PN5180EVENTQUEUE_H */
@@ -21,19 +21,32 @@
 #include <Arduino.h>
 #include "PN5180FeliCa.h"
 #include <PN5180.h>
+#include "PN5180Profile.h"
 #include "Debug.h"
 
 PN5180FeliCa::PN5180FeliCa(uint8_t SSpin, uint8_t BUSYpin, uint8_t RSTpin)
               : PN5180(SSpin, BUSYpin, RSTpin) {
+  pollSlots = 1;
+  pollCollisions = 0;
+  memset(maxBlocksIDm, 0, sizeof(maxBlocksIDm));
+  maxReadBlocks = FELICA_MAX_READ_BLOCKS;
+  maxWriteBlocks = FELICA_MAX_WRITE_BLOCKS;
 }
 
+/*
+* Switch to FeliCa and turn on the RF field. Both are skipped, if already done,
+* so this is cheap before each command.
+*/
 bool PN5180FeliCa::setupRF() {
   PN5180DEBUG(F("Loading RF-Configuration...\n"));
-  if (loadRFConfig(0x09, 0x89)) {  // FeliCa 424 parameters
+  if (applyProfile(PN5180_PROFILE_FELICA)) {  // FeliCa 424 parameters, Crypto off
     PN5180DEBUG(F("done.\n"));
   }
   else return false;
 
+  if (isRFOn())
+    return true;
+
   PN5180DEBUG(F("Turning ON RF field...\n"));
   if (setRF_on()) {
     PN5180DEBUG(F("done.\n"));
@@ -43,6 +56,13 @@ bool PN5180FeliCa::setupRF() {
   return true;
 }
 
+/*
+* Switch to FeliCa with the RF field already on, e.g. after another protocol was used
+*/
+bool PN5180FeliCa::loadProtocolConfig() {
+  return applyProfile(PN5180_PROFILE_FELICA);
+}
+
 /*
 * buffer : must be 20 byte array
 * buffer[0-1] is length and 01
@@ -55,44 +75,374 @@ bool PN5180FeliCa::setupRF() {
 * -	8 if a FeliCa tag was recognized
 */
 uint8_t PN5180FeliCa::pol_req(uint8_t *buffer) {
+	FeliCaCard card;
+	// POLLING for any target, System Code request, 1 timeslot only
+	if (0 == polling(&card, 1, 1, 0xFFFF, 0x01))
+	  return 0;
+
+	//response packet is 0x14 (20 bytes total length), 0x01 Response Code, 8 IDm bytes, 8 PMm bytes, 2 Request Data bytes
+	buffer[0] = 0x14;
+	buffer[1] = 0x01;
+	for (int i=0; i<8; i++) {
+		buffer[2+i] = card.idm[i];
+		buffer[10+i] = card.pmm[i];
+	}
+	buffer[18] = card.requestData[0];
+	buffer[19] = card.requestData[1];
+	return 8;
+}
+
+/*
+* POLLING with several time slots. Each card answers in a random time slot, so
+* several cards can be detected with one request. The response of slot n starts
+* 2.417ms + n * 1.208ms after the request. A slot is too short for the host to
+* fetch a response and restart the receiver, so all responses are received in one
+* window with multiple frame reception, and read from the RX buffer at the end.
+*
+* cards : array of maxCards entries, receives IDm, PMm and request data
+* timeSlots : 1, 2, 4, 8 or 16
+* systemCode : 0xFFFF for any system
+* requestCode : 0x00 no request data, 0x01 system code, 0x02 communication performance
+*
+* return value: number of cards found
+*/
+uint8_t PN5180FeliCa::polling(FeliCaCard *cards, uint8_t maxCards, uint8_t timeSlots,
+                              uint16_t systemCode, uint8_t requestCode) {
 	uint8_t cmd[6];
-	uint8_t uidLength = 0;
-	// Load FeliCa 424 protocol
-	if (!loadRFConfig(0x09, 0x89))
+	uint8_t numCards = 0;
+	pollCollisions = 0;
+	if ((timeSlots == 0) || (timeSlots > 16) || (timeSlots & (timeSlots - 1)))
 	  return 0;
-	// OFF Crypto
-	if (!writeRegisterWithAndMask(SYSTEM_CONFIG, 0xFFFFFFBF))
+	if (!setupRF())
 	  return 0;
 
-	//send FeliCa request (every packet starts with length)
-    cmd[0] = 0x06;             //total length
-	cmd[1] = 0x00;             //POL_REQ command
-	cmd[2] = 0xFF;             //
-	cmd[3] = 0xFF;             // any target
-	cmd[4] = 0x01;             // System Code request
-	cmd[5] = 0x00;             // 1 timeslot only
+	cmd[0] = 0x06;                // total length
+	cmd[1] = 0x00;                // POLLING command
+	cmd[2] = (systemCode >> 8);
+	cmd[3] = (systemCode & 0xFF);
+	cmd[4] = requestCode;
+	cmd[5] = timeSlots - 1;       // TSN
 
-	if (!sendData(cmd, 6, 0x00))
+	writeRegisterWithOrMask(TRANSCEIVE_CONTROL, RX_MULTIPLE_ENABLE);
+	clearIRQStatus(0xffffffff);
+	bool sent = sendData(cmd, 6, 0x00);
+	uint32_t start = micros();
+	// last slot, plus the response time of a 20 bytes frame
+	uint32_t window = 2417 + timeSlots * 1208UL + 1500;
+	if (sent) {
+		while ((uint32_t)(micros() - start) < window);
+	}
+	writeRegisterWithAndMask(SYSTEM_CONFIG, ~SYSTEM_CONFIG_COMMAND_MASK);  // Idle/StopCom Command
+	writeRegisterWithAndMask(TRANSCEIVE_CONTROL, ~RX_MULTIPLE_ENABLE);
+	if (!sent)
 	  return 0;
-    //wait a little to avoid bug with some cards
-    delay(50);
 
-    //response packet should be 0x14 (20 bytes total length), 0x01 Response Code, 8 IDm bytes, 8 PMm bytes, 2 Request Data bytes
-    //READ 20 bytes reply
-  uint8_t *internalBuffer = readData(20);
-	if (!internalBuffer)
+	uint32_t rxStatus;
+	readRegister(RX_STATUS, &rxStatus);
+	uint8_t numFrames = RX_NUM_FRAMES_RECEIVED(rxStatus);
+	if (numFrames > 15) numFrames = 15;  // 508 bytes RX buffer
+	uint8_t *frames = (numFrames > 0) ? readData(numFrames * RX_MULTIPLE_SLOT_SIZE) : 0L;
+
+	for (uint8_t f = 0; frames && (f < numFrames); f++) {
+		uint8_t *resp = &frames[f * RX_MULTIPLE_SLOT_SIZE];
+		uint8_t status = resp[RX_MULTIPLE_SLOT_SIZE - 1];
+		uint8_t len = RX_MULTIPLE_LENGTH(status);
+		if (RX_MULTIPLE_ERROR(status)) {
+			pollCollisions++;
+			continue;
+		}
+		if ((len < 18) || (len > 20) || (resp[0] != len) || (resp[1] != 0x01))
+		  continue;
+		bool known = false;
+		for (uint8_t n = 0; n < numCards; n++) {
+			if (0 == memcmp(cards[n].idm, &resp[2], 8)) known = true;
+		}
+		if (!known && (numCards < maxCards)) {
+			memcpy(cards[numCards].idm, &resp[2], 8);
+			memcpy(cards[numCards].pmm, &resp[10], 8);
+			cards[numCards].requestData[0] = (len == 20) ? resp[18] : 0;
+			cards[numCards].requestData[1] = (len == 20) ? resp[19] : 0;
+			numCards++;
+		}
+	}
+
+	PN5180DEBUG(F("POLLING: slots="));
+	PN5180DEBUG(timeSlots);
+	PN5180DEBUG(F(", frames="));
+	PN5180DEBUG(numFrames);
+	PN5180DEBUG(F(", cards="));
+	PN5180DEBUG(numCards);
+	PN5180DEBUG(F(", collisions="));
+	PN5180DEBUG(pollCollisions);
+	PN5180DEBUG("\n");
+	return numCards;
+}
+
+/*
+* POLLING with an adaptive number of time slots: the number of slots is doubled
+* after a request with collided responses, or with more cards than half of the
+* slots. It is halved, if less than a quarter of the slots were used.
+*/
+uint8_t PN5180FeliCa::polling(FeliCaCard *cards, uint8_t maxCards) {
+	uint8_t slots = pollSlots;
+	uint8_t numCards = polling(cards, maxCards, slots);
+	if ((pollCollisions > 0) || (2 * numCards > slots)) {
+		if (pollSlots < 16) pollSlots *= 2;
+	}
+	else if ((4 * numCards < slots) && (pollSlots > 1)) {
+		pollSlots /= 2;
+	}
+	return numCards;
+}
+
+/*
+* Request Response, code=04, addressed by IDm. Only the card with this IDm answers,
+* so this is the cheapest check, if a known card is still in the field.
+*
+* mode : receives the current mode of the card (opt.)
+* return value: true, if the card answered
+*/
+bool PN5180FeliCa::requestResponse(const uint8_t *idm, uint8_t *mode) {
+	uint8_t cmd[10];
+	cmd[0] = 10;
+	cmd[1] = 0x04;
+	memcpy(&cmd[2], idm, 8);
+
+	if (!setupRF())
+	  return false;
+	clearIRQStatus(0xffffffff);
+	if (!sendData(cmd, 10, 0x00)) {
+		invalidateRFConfig();
+		return false;
+	}
+	// LEN, response code 05, IDm, mode
+	uint16_t rxLen = waitForRx(FELICA_REQUEST_RESPONSE_TIMEOUT);
+	if (rxLen != 11)
+	  return false;
+	uint8_t *resp = readData(rxLen);
+	if (!resp || (resp[0] != 11) || (resp[1] != 0x05) || (0 != memcmp(&resp[2], idm, 8)))
+	  return false;
+	if (mode) *mode = resp[10];
+	return true;
+}
+
+/*
+* Wait for the end of reception, at most timeout milliseconds.
+* return value: number of bytes received, zero on timeout or error
+*/
+uint16_t PN5180FeliCa::waitForRx(uint32_t timeout) {
+	uint32_t start = millis();
+	while (0 == (getIRQStatus() & RX_IRQ_STAT)) {
+		if ((uint32_t)(millis() - start) > timeout)
+		  return 0;
+	}
+	uint32_t rxStatus;
+	readRegister(RX_STATUS, &rxStatus);
+	if (rxStatus & (RX_DATA_INTEGRITY_ERROR | RX_PROTOCOL_ERROR | RX_COLLISION_DETECTED))
 	  return 0;
- for (int i=0; i<20; i++) {
-    buffer[i] = internalBuffer[i];
- }
- 
-    //check Response Code
-    if ( buffer[1] != 0x01 ){
-        uidLength = 0;
-    } else {
-        uidLength = 8;
-    }
-    return uidLength;
+	return (uint16_t)(rxStatus & 0x000001ff);
+}
+
+/*
+* Maximum response time of a command in milliseconds, from the PMm byte of the
+* command: bits 0..2 A, bits 3..5 B, bits 6..7 E
+*   T = 256 * 16 / fc * ((B + 1) * n + (A + 1)) * 4^E
+* n is the number of blocks or services. A margin for the SPI host interface is added.
+*/
+uint32_t PN5180FeliCa::responseTimeout(uint8_t pmmByte, uint8_t n) {
+	uint32_t a = pmmByte & 0x07;
+	uint32_t b = (pmmByte >> 3) & 0x07;
+	uint8_t e = (pmmByte >> 6) & 0x03;
+	uint32_t us = (302UL * ((b + 1) * n + (a + 1))) << (2 * e);
+	return (us / 1000) + 5;
+}
+
+/*
+* The max. number of blocks per command is learned per card, it is reset for
+* another card
+*/
+void PN5180FeliCa::selectCard(const FeliCaCard *card) {
+	if (0 != memcmp(maxBlocksIDm, card->idm, 8)) {
+		memcpy(maxBlocksIDm, card->idm, 8);
+		maxReadBlocks = FELICA_MAX_READ_BLOCKS;
+		maxWriteBlocks = FELICA_MAX_WRITE_BLOCKS;
+	}
+}
+
+/*
+* Header of Read/Write Without Encryption: length, command code, IDm, service code
+* list and block list. Block list elements are 2 bytes for block numbers up to 255,
+* otherwise 3 bytes.
+* return value: length of the header
+*/
+uint8_t PN5180FeliCa::buildBlockCommand(uint8_t *cmd, uint8_t code, const FeliCaCard *card,
+                                        uint8_t numServices, const uint16_t *serviceCodes,
+                                        uint8_t numBlocks, const FeliCaBlock *blocks) {
+	uint8_t len = 1;
+	cmd[len++] = code;
+	for (int i = 0; i < 8; i++) cmd[len++] = card->idm[i];
+	cmd[len++] = numServices;
+	for (int i = 0; i < numServices; i++) {
+		cmd[len++] = serviceCodes[i] & 0xFF; // little endian
+		cmd[len++] = serviceCodes[i] >> 8;
+	}
+	cmd[len++] = numBlocks;
+	for (int i = 0; i < numBlocks; i++) {
+		if (blocks[i].block < 256) {
+			cmd[len++] = 0x80 | (blocks[i].service & 0x0F);
+			cmd[len++] = blocks[i].block;
+		}
+		else {
+			cmd[len++] = blocks[i].service & 0x0F;
+			cmd[len++] = blocks[i].block & 0xFF;
+			cmd[len++] = blocks[i].block >> 8;
+		}
+	}
+	return len;
+}
+
+/*
+* Read Without Encryption of numBlocks blocks from up to 16 services with one command.
+* The response is awaited with the read timeout from the PMm of the card.
+*
+* data : receives 16 * numBlocks bytes
+* return value: status flag 1 in the high byte, status flag 2 in the low byte,
+*               zero on success, 0xFFFF if the card did not answer
+*/
+uint16_t PN5180FeliCa::readWithoutEncryption(const FeliCaCard *card, uint8_t numServices, const uint16_t *serviceCodes,
+                                             uint8_t numBlocks, const FeliCaBlock *blocks, uint8_t *data) {
+	if ((numServices == 0) || (numServices > FELICA_MAX_SERVICES) ||
+	    (numBlocks == 0) || (numBlocks > FELICA_MAX_READ_BLOCKS))
+	  return 0xFFFF;
+	uint8_t cmd[12 + 2*FELICA_MAX_SERVICES + 3*FELICA_MAX_READ_BLOCKS];
+	uint8_t len = buildBlockCommand(cmd, 0x06, card, numServices, serviceCodes, numBlocks, blocks);
+	cmd[0] = len;
+
+	if (!setupRF())
+	  return 0xFFFF;
+	clearIRQStatus(0xffffffff);
+	if (!sendData(cmd, len, 0x00)) {
+		invalidateRFConfig();
+		return 0xFFFF;
+	}
+	uint16_t rxLen = waitForRx(responseTimeout(card->pmm[5], numBlocks));
+	if (rxLen < 12)
+	  return 0xFFFF;
+	uint8_t *resp = readData(rxLen);
+	if (!resp || (resp[0] != rxLen) || (resp[1] != 0x07) || (0 != memcmp(&resp[2], card->idm, 8)))
+	  return 0xFFFF;
+	uint16_t status = (resp[10] << 8) | resp[11];
+	if (status != 0)
+	  return status;
+	if ((rxLen != 13 + 16*numBlocks) || (resp[12] != numBlocks))
+	  return 0xFFFF;
+	memcpy(data, &resp[13], 16*numBlocks);
+	return 0;
+}
+
+/*
+* Write Without Encryption of numBlocks blocks to up to 16 services with one command.
+* The response is awaited with the write timeout from the PMm of the card.
+*
+* data : 16 * numBlocks bytes
+* return value: status flag 1 in the high byte, status flag 2 in the low byte,
+*               zero on success, 0xFFFF if the card did not answer
+*/
+uint16_t PN5180FeliCa::writeWithoutEncryption(const FeliCaCard *card, uint8_t numServices, const uint16_t *serviceCodes,
+                                              uint8_t numBlocks, const FeliCaBlock *blocks, const uint8_t *data) {
+	if ((numServices == 0) || (numServices > FELICA_MAX_SERVICES) ||
+	    (numBlocks == 0) || (numBlocks > FELICA_MAX_WRITE_BLOCKS))
+	  return 0xFFFF;
+	uint8_t cmd[12 + 2*FELICA_MAX_SERVICES + 19*FELICA_MAX_WRITE_BLOCKS];
+	uint16_t len = buildBlockCommand(cmd, 0x08, card, numServices, serviceCodes, numBlocks, blocks);
+	if (len + 16*numBlocks > 254)
+	  return 0xFFFF;
+	memcpy(&cmd[len], data, 16*numBlocks);
+	len += 16*numBlocks;
+	cmd[0] = len;
+
+	if (!setupRF())
+	  return 0xFFFF;
+	clearIRQStatus(0xffffffff);
+	if (!sendData(cmd, len, 0x00)) {
+		invalidateRFConfig();
+		return 0xFFFF;
+	}
+	uint16_t rxLen = waitForRx(responseTimeout(card->pmm[6], numBlocks));
+	if (rxLen != 12)
+	  return 0xFFFF;
+	uint8_t *resp = readData(rxLen);
+	if (!resp || (resp[0] != 12) || (resp[1] != 0x09) || (0 != memcmp(&resp[2], card->idm, 8)))
+	  return 0xFFFF;
+	return (resp[10] << 8) | resp[11];
+}
+
+/*
+* Read a range of blocks of one service. The range is read with as few commands as
+* possible: each command reads the max. number of blocks supported by the card. If
+* the card reports an illegal number of blocks (status flag 2 0xA2), the number is
+* halved and remembered for this card.
+*
+* data : receives 16 * numBlocks bytes
+* return value: true, if all blocks were read
+*/
+bool PN5180FeliCa::readBlocks(const FeliCaCard *card, uint16_t serviceCode, uint16_t firstBlock, uint16_t numBlocks, uint8_t *data) {
+	selectCard(card);
+	FeliCaBlock blocks[FELICA_MAX_READ_BLOCKS];
+	uint16_t done = 0;
+	while (done < numBlocks) {
+		uint8_t n = (numBlocks - done < maxReadBlocks) ? (numBlocks - done) : maxReadBlocks;
+		for (uint8_t i = 0; i < n; i++) {
+			blocks[i].service = 0;
+			blocks[i].block = firstBlock + done + i;
+		}
+		uint16_t status = readWithoutEncryption(card, 1, &serviceCode, n, blocks, &data[16*done]);
+		if (((status & 0xFF) == 0xA2) && (maxReadBlocks > 1)) {
+			maxReadBlocks = (n > 1) ? n/2 : 1;
+			continue;
+		}
+		if (status != 0) {
+			PN5180DEBUG(F("FeliCa read status="));
+			PN5180DEBUG(formatHex(status));
+			PN5180DEBUG("\n");
+			return false;
+		}
+		done += n;
+	}
+	return true;
+}
+
+/*
+* Write a range of blocks of one service, with as few commands as possible,
+* see readBlocks()
+*
+* data : 16 * numBlocks bytes
+* return value: true, if all blocks were written
+*/
+bool PN5180FeliCa::writeBlocks(const FeliCaCard *card, uint16_t serviceCode, uint16_t firstBlock, uint16_t numBlocks, const uint8_t *data) {
+	selectCard(card);
+	FeliCaBlock blocks[FELICA_MAX_WRITE_BLOCKS];
+	uint16_t done = 0;
+	while (done < numBlocks) {
+		uint8_t n = (numBlocks - done < maxWriteBlocks) ? (numBlocks - done) : maxWriteBlocks;
+		for (uint8_t i = 0; i < n; i++) {
+			blocks[i].service = 0;
+			blocks[i].block = firstBlock + done + i;
+		}
+		uint16_t status = writeWithoutEncryption(card, 1, &serviceCode, n, blocks, &data[16*done]);
+		if (((status & 0xFF) == 0xA2) && (maxWriteBlocks > 1)) {
+			maxWriteBlocks = (n > 1) ? n/2 : 1;
+			continue;
+		}
+		if (status != 0) {
+			PN5180DEBUG(F("FeliCa write status="));
+			PN5180DEBUG(formatHex(status));
+			PN5180DEBUG("\n");
+			return false;
+		}
+		done += n;
+	}
+	return true;
 }
 
 uint8_t PN5180FeliCa::readCardSerial(uint8_t *buffer) {
@@ -21,18 +21,82 @@
 
 #include "PN5180.h"
 
+// Max. number of cards returned by one POLLING request
+#ifndef FELICA_MAX_CARDS
+#if defined(__AVR__)
+#define FELICA_MAX_CARDS  (4)
+#else
+#define FELICA_MAX_CARDS  (16)
+#endif
+#endif
+
+// Max. number of blocks in one Read/Write Without Encryption, limited by the
+// frame size, the card may support less
+#define FELICA_MAX_READ_BLOCKS   (15)
+#define FELICA_MAX_WRITE_BLOCKS  (12)
+// Max. number of services in one command
+#define FELICA_MAX_SERVICES      (16)
+
+// Max. time to wait for the response to Request Response in milliseconds, used
+// since the PMm of the card is not known to all callers
+#ifndef FELICA_REQUEST_RESPONSE_TIMEOUT
+#define FELICA_REQUEST_RESPONSE_TIMEOUT  (10)
+#endif
+
+struct FeliCaCard {
+  uint8_t idm[8];
+  uint8_t pmm[8];
+  uint8_t requestData[2];   // e.g. system code, if requested
+};
+
+// Element of a block list: service is the index in the service code list
+struct FeliCaBlock {
+  uint8_t service;
+  uint16_t block;
+};
+
 class PN5180FeliCa : public PN5180 {
 
 public:
   PN5180FeliCa(uint8_t SSpin, uint8_t BUSYpin, uint8_t RSTpin);
 
+private:
+  // adaptive number of time slots for polling()
+  uint8_t pollSlots;
+  uint16_t pollCollisions;   // corrupted responses of the last POLLING request
+  // max. blocks per command, learned for the card with IDm maxBlocksIDm
+  uint8_t maxBlocksIDm[8];
+  uint8_t maxReadBlocks;
+  uint8_t maxWriteBlocks;
+
+  uint16_t waitForRx(uint32_t timeout);
+  static uint32_t responseTimeout(uint8_t pmmByte, uint8_t n);
+  uint8_t buildBlockCommand(uint8_t *cmd, uint8_t code, const FeliCaCard *card,
+                            uint8_t numServices, const uint16_t *serviceCodes,
+                            uint8_t numBlocks, const FeliCaBlock *blocks);
+  void selectCard(const FeliCaCard *card);
+
 public:
   uint8_t pol_req(uint8_t *buffer);
+  uint8_t polling(FeliCaCard *cards, uint8_t maxCards, uint8_t timeSlots,
+                  uint16_t systemCode = 0xFFFF, uint8_t requestCode = 0x01);
+  uint8_t polling(FeliCaCard *cards, uint8_t maxCards);
+  uint8_t getPollingSlots() { return pollSlots; }
+  uint16_t getPollingCollisions() { return pollCollisions; }
+  bool requestResponse(const uint8_t *idm, uint8_t *mode = NULL);
+  // Read/Write Without Encryption
+  uint16_t readWithoutEncryption(const FeliCaCard *card, uint8_t numServices, const uint16_t *serviceCodes,
+                                 uint8_t numBlocks, const FeliCaBlock *blocks, uint8_t *data);
+  uint16_t writeWithoutEncryption(const FeliCaCard *card, uint8_t numServices, const uint16_t *serviceCodes,
+                                  uint8_t numBlocks, const FeliCaBlock *blocks, const uint8_t *data);
+  bool readBlocks(const FeliCaCard *card, uint16_t serviceCode, uint16_t firstBlock, uint16_t numBlocks, uint8_t *data);
+  bool writeBlocks(const FeliCaCard *card, uint16_t serviceCode, uint16_t firstBlock, uint16_t numBlocks, const uint8_t *data);
   /*
    * Helper functions
    */
 public:   
   bool setupRF();
+  bool loadProtocolConfig();
   uint8_t readCardSerial(uint8_t *buffer);    
   bool isCardPresent();    
 };
@@ -21,10 +21,20 @@
 #include <Arduino.h>
 #include "PN5180ISO14443.h"
 #include <PN5180.h>
+#include "PN5180CRC.h"
+#include "PN5180Profile.h"
 #include "Debug.h"
 
 PN5180ISO14443::PN5180ISO14443(uint8_t SSpin, uint8_t BUSYpin, uint8_t RSTpin) 
               : PN5180(SSpin, BUSYpin, RSTpin) {
+  isoDepActive = false;
+  isoDepBytes = 0;
+  isoDepTime = 0;
+  activeUidLength = 0;
+  ntagPages = 0;
+  mfcAuthSector = -1;
+  cardSelected = false;
+  clearMifareKeyCache();
 }
 
 bool PN5180ISO14443::setupRF() {
@@ -43,6 +53,15 @@ bool PN5180ISO14443::setupRF() {
   return true;
 }
 
+/*
+* Switch to ISO14443A with the RF field already on, e.g. after another protocol was used
+*/
+bool PN5180ISO14443::loadProtocolConfig() {
+  isoDepActive = false;
+  cardSelected = false;
+  return applyProfile(PN5180_PROFILE_ISO14443A);
+}
+
 uint16_t PN5180ISO14443::rxBytesReceived() {
 	uint32_t rxStatus;
 	uint16_t len = 0;
@@ -63,148 +82,351 @@ uint16_t PN5180ISO14443::rxBytesReceived() {
 * -	zero if no tag was recognized
 * -	single Size UID (4 byte)
 * -	double Size UID (7 byte)
-* -	triple Size UID (10 byte) - not yet supported
+* -	triple Size UID (10 byte) - only the first 7 bytes fit into buffer,
+*	use activateTypeA(ISO14443Card *, kind) to get the complete UID
 */
 uint8_t PN5180ISO14443::activateTypeA(uint8_t *buffer, uint8_t kind) {
-	uint8_t cmd[7];
-	uint8_t uidLength = 0;
-	// Load standard TypeA protocol
-	if (!loadRFConfig(0x0, 0x80)) 
+	ISO14443Card card;
+	uint8_t uidLength = activateTypeA(&card, kind);
+	if (0 == uidLength)
 	  return 0;
+	buffer[0] = card.atqa[0];
+	buffer[1] = card.atqa[1];
+	buffer[2] = card.sak;
+	for (int i = 0; i < 7; i++) buffer[3+i] = (i < uidLength) ? card.uid[i] : 0;
+	return uidLength;
+}
 
-	// OFF Crypto
-	if (!writeRegisterWithAndMask(SYSTEM_CONFIG, 0xFFFFFFBF))
-	  return 0;
-	// Clear RX CRC
-	if (!writeRegisterWithAndMask(CRC_RX_CONFIG, 0xFFFFFFFE))
-	  return 0;
-	// Clear TX CRC
-	if (!writeRegisterWithAndMask(CRC_TX_CONFIG, 0xFFFFFFFE))
+/*
+* Activation of one card with REQA/WUPA, followed by ANTICOLLISION and SELECT for
+* each cascade level. If several cards answer, the collisions are resolved bit by bit,
+* so exactly one of them is selected.
+*
+* card : ATQA, SAK and the complete UID of the selected card
+* kind : 0  we send REQA, 1 we send WUPA
+*
+* return value: the uid length (4, 7 or 10), zero if no tag was recognized
+*/
+uint8_t PN5180ISO14443::activateTypeA(ISO14443Card *card, uint8_t kind) {
+	uint8_t cmd[7];
+	card->uidLength = 0;
+	card->anticollisionLoops = 0;
+	// Load standard TypeA protocol, Crypto and CRC off
+	if (!applyProfile(PN5180_PROFILE_ISO14443A))
 	  return 0;
+
+	mfcAuthSector = -1;
+	cardSelected = false;
+	isoDepActive = false;
 	//Send REQA/WUPA, 7 bits in last byte
 	cmd[0] = (kind == 0) ? 0x26 : 0x52;
 	if (!sendData(cmd, 1, 0x07))
 	  return 0;
 	// READ 2 bytes ATQA into  buffer
-	if (!readData(2, buffer)) 
-	  return 0;
-	//Send Anti collision 1, 8 bits in last byte
-	cmd[0] = 0x93;
-	cmd[1] = 0x20;
-	if (!sendData(cmd, 2, 0x00))
+	if (!readData(2, card->atqa)) 
 	  return 0;
-	//Read 5 bytes, we will store at offset 2 for later usage
-	if (!readData(5, cmd+2)) 
+	if ((card->atqa[0] == 0xFF) && (card->atqa[1] == 0xFF))
 	  return 0;
+
+	// Cascade levels 1..3, select codes 0x93, 0x95, 0x97
+	for (uint8_t level = 0; level < 3; level++) {
+		uint8_t sel = 0x93 + 2*level;
+		// 4 bytes UID CLn + BCC
+		uint8_t uidCL[5];
+		if (!anticollision(sel, uidCL, &card->anticollisionLoops))
+		  return 0;
+		if (!select(sel, uidCL, &card->sak))
+		  return 0;
+		// If Bit 3 of SAK is 0, the UID is complete
+		if ((card->sak & 0x04) == 0) {
+			for (int i = 0; i < 4; i++) card->uid[card->uidLength++] = uidCL[i];
+			if (!enableCRC())
+			  return 0;
+			setActiveCard(card);
+			return card->uidLength;
+		}
+		// Take next 3 bytes of UID, ignore first byte 88(CT)
+		if (uidCL[0] != 0x88)
+		  return 0;
+		for (int i = 1; i < 4; i++) card->uid[card->uidLength++] = uidCL[i];
+	}
+	return 0; // more than 3 cascade levels
+}
+
+/*
+* ANTICOLLISION of one cascade level, CRC must be disabled.
+* The anticollision frame is sent with the already known bits of the UID CLn. If the
+* answers of several cards collide, RX_STATUS reports the position of the first
+* collided bit. This bit is set to 1 and the next frame is sent with all bits up to
+* and including it, so only cards with matching UID bits answer with the rest.
+*
+* sel : select code of cascade level, 0x93, 0x95 or 0x97
+* uidCL : 5 byte array, receives 4 bytes UID CLn and BCC
+* loops : incremented for every ANTICOLLISION frame sent
+*/
+bool PN5180ISO14443::anticollision(uint8_t sel, uint8_t *uidCL, uint8_t *loops) {
+	uint8_t cmd[7];
+	uint8_t knownBits = 0;
+	for (int i = 0; i < 5; i++) uidCL[i] = 0;
+
+	while (true) {
+		uint8_t knownBytes = knownBits / 8;
+		uint8_t lastBits = knownBits % 8;
+		uint8_t txBytes = knownBytes + ((lastBits > 0) ? 1 : 0);
+
+		cmd[0] = sel;
+		cmd[1] = ((2 + knownBytes) << 4) | lastBits; // NVB: number of valid bits
+		for (int i = 0; i < txBytes; i++) cmd[2+i] = uidCL[i];
+
+		// first received bit is stored at position lastBits of the first byte
+		if (!writeRegisterWithAndMask(CRC_RX_CONFIG, 0xFFFFFE3F))
+		  return false;
+		if ((lastBits > 0) && !writeRegisterWithOrMask(CRC_RX_CONFIG, ((uint32_t)lastBits) << 6))
+		  return false;
+
+		if (!sendData(cmd, 2 + txBytes, lastBits))
+		  return false;
+		(*loops)++;
+
+		uint32_t rxStatus;
+		readRegister(RX_STATUS, &rxStatus);
+		uint16_t len = (uint16_t)(rxStatus & 0x000001ff);
+		if ((len == 0) || (len > 5 - knownBytes))
+		  return false;
+
+		uint8_t *resp = readData(len);
+		if (!resp)
+		  return false;
+		// merge received bits with the known bits
+		uint8_t keepMask = (1 << lastBits) - 1;
+		uidCL[knownBytes] = (uidCL[knownBytes] & keepMask) | (resp[0] & ~keepMask);
+		for (int i = 1; i < len; i++) uidCL[knownBytes+i] = resp[i];
+
+		if (0 == (rxStatus & RX_COLLISION_DETECTED))
+		  break;
+
+		// position of collision, counted from bit 0 of the first received byte
+		uint8_t collPos = (knownBytes * 8) + ((rxStatus >> 19) & 0x7f);
+		if (collPos >= 40)
+		  return false;
+		uint8_t collMask = (1 << (collPos % 8));
+		// choose 1 for the collided bit, discard the bits after it
+		uidCL[collPos / 8] = (uidCL[collPos / 8] & (collMask - 1)) | collMask;
+		for (int i = collPos/8 + 1; i < 5; i++) uidCL[i] = 0;
+		knownBits = collPos + 1;
+	}
+
+	writeRegisterWithAndMask(CRC_RX_CONFIG, 0xFFFFFE3F);
+
+	// check BCC
+	if ((uidCL[0] ^ uidCL[1] ^ uidCL[2] ^ uidCL[3]) != uidCL[4])
+	  return false;
+	return true;
+}
+
+/*
+* SELECT of one cascade level with the complete UID CLn and BCC.
+* The CRC engine of the PN5180 stays disabled during activation, so the
+* CRC_A of SELECT and SAK is calculated and checked here. The SAK is returned.
+*/
+bool PN5180ISO14443::select(uint8_t sel, uint8_t *uidCL, uint8_t *sak) {
+	uint8_t cmd[9];
+	//Send Select with 4 bytes UID CLn and BCC
+	cmd[0] = sel;
+	cmd[1] = 0x70;
+	for (int i = 0; i < 5; i++) cmd[2+i] = uidCL[i];
+	PN5180CRC::append(cmd, 7, PN5180CRC::iso14443a(cmd, 7));
+	clearIRQStatus(0xffffffff);
+	if (!sendData(cmd, 9, 0x00)) 
+	  return false;
+	//Read 1 byte SAK, followed by CRC_A
+	if (waitForRx(5) != 3)
+	  return false;
+	uint8_t *resp = readData(3);
+	if (!resp || !PN5180CRC::checkISO14443A(resp, 3))
+	  return false;
+	*sak = resp[0];
+	return true;
+}
+
+/*
+* Enable the CRC engine for TX and RX, after activation is complete
+*/
+bool PN5180ISO14443::enableCRC() {
 	//Enable RX CRC calculation
-	if (!writeRegisterWithOrMask(CRC_RX_CONFIG, 0x01)) 
-	  return 0;
+	if (!writeRegisterWithOrMask(CRC_RX_CONFIG, CRC_ENABLE)) 
+	  return false;
 	//Enable TX CRC calculation
-	if (!writeRegisterWithOrMask(CRC_TX_CONFIG, 0x01)) 
-	  return 0;
-	//Send Select anti collision 1, the remaining bytes are already in offset 2 onwards
-	cmd[0] = 0x93;
-	cmd[1] = 0x70;
-	if (!sendData(cmd, 7, 0x00)) 
-	  return 0;
-	//Read 1 byte SAK into buffer[2]
-	if (!readData(1, buffer+2)) 
-	  return 0;
-	// Check if the tag is 4 Byte UID or 7 byte UID and requires anti collision 2
-	// If Bit 3 is 0 it is 4 Byte UID
-	if ((buffer[2] & 0x04) == 0) {
-		// Take first 4 bytes of anti collision as UID store at offset 3 onwards. job done
-		for (int i = 0; i < 4; i++) buffer[3+i] = cmd[2 + i];
-		uidLength = 4;
+	if (!writeRegisterWithOrMask(CRC_TX_CONFIG, CRC_ENABLE)) 
+	  return false;
+	return true;
+}
+
+/*
+* Fast re-selection of a card with known UID: WUPA, followed directly by SELECT
+* for each cascade level with the stored UID CLn and BCC. No ANTICOLLISION frames
+* are exchanged, and the CRC engine is enabled only once at the end.
+* The card must be in IDLE or HALT state, e.g. after mifareHalt().
+*
+* card : uid and uidLength of the card, receives ATQA and SAK
+* return value: true, if the card answered all SELECTs
+*/
+bool PN5180ISO14443::reselect(ISO14443Card *card) {
+	uint8_t cmd[1];
+	uint8_t levels = (card->uidLength == 4) ? 1 : (card->uidLength == 7) ? 2 : (card->uidLength == 10) ? 3 : 0;
+	if (levels == 0)
+	  return false;
+	// Load standard TypeA protocol, Crypto and CRC off
+	if (!applyProfile(PN5180_PROFILE_ISO14443A))
+	  return false;
+	mfcAuthSector = -1;
+	cardSelected = false;
+	isoDepActive = false;
+	//Send WUPA, 7 bits in last byte
+	cmd[0] = 0x52;
+	if (!sendData(cmd, 1, 0x07))
+	  return false;
+	if (rxBytesReceived() != 2)
+	  return false;
+	// READ 2 bytes ATQA
+	if (!readData(2, card->atqa)) 
+	  return false;
+
+	uint8_t pos = 0;
+	for (uint8_t level = 0; level < levels; level++) {
+		uint8_t uidCL[5];
+		if (level < levels-1) {
+			// cascade tag 88(CT), followed by next 3 bytes of UID
+			uidCL[0] = 0x88;
+			for (int i = 1; i < 4; i++) uidCL[i] = card->uid[pos++];
+		}
+		else {
+			for (int i = 0; i < 4; i++) uidCL[i] = card->uid[pos++];
+		}
+		uidCL[4] = uidCL[0] ^ uidCL[1] ^ uidCL[2] ^ uidCL[3]; // BCC
+		if (!select(0x93 + 2*level, uidCL, &card->sak))
+		  return false;
+		// Bit 3 of SAK must be set for all but the last cascade level
+		if (((card->sak & 0x04) != 0) != (level < levels-1))
+		  return false;
 	}
-	else {
-		// Take First 3 bytes of UID, Ignore first byte 88(CT)
-		if (cmd[2] != 0x88)
-		  return 0;
-		for (int i = 0; i < 3; i++) buffer[3+i] = cmd[3 + i];
-		// Clear RX CRC
-		if (!writeRegisterWithAndMask(CRC_RX_CONFIG, 0xFFFFFFFE)) 
-	      return 0;
-		// Clear TX CRC
-		if (!writeRegisterWithAndMask(CRC_TX_CONFIG, 0xFFFFFFFE)) 
-	      return 0;
-		// Do anti collision 2
-		cmd[0] = 0x95;
-		cmd[1] = 0x20;
-		if (!sendData(cmd, 2, 0x00)) 
-	      return 0;
-		//Read 5 bytes. we will store at offset 2 for later use
-		if (!readData(5, cmd+2)) 
-	      return 0;
-		// first 4 bytes belongs to last 4 UID bytes, we keep it.
-		for (int i = 0; i < 4; i++) {
-		  buffer[6 + i] = cmd[2+i];
-		}
-		//Enable RX CRC calculation
-		if (!writeRegisterWithOrMask(CRC_RX_CONFIG, 0x01)) 
-	      return 0;
-		//Enable TX CRC calculation
-		if (!writeRegisterWithOrMask(CRC_TX_CONFIG, 0x01)) 
-	      return 0;
-		//Send Select anti collision 2 
-		cmd[0] = 0x95;
-		cmd[1] = 0x70;
-		if (!sendData(cmd, 7, 0x00)) 
-	      return 0;
-		//Read 1 byte SAK into buffer[2]
-		if (!readData(1, buffer + 2)) 
-	      return 0;	
-		uidLength = 7;
-	}
-    return uidLength;
+	if (!enableCRC())
+	  return false;
+	setActiveCard(card);
+	return true;
+}
+
+/*
+* Remember the UID of the selected card, the cached GET_VERSION and MIFARE
+* Classic keys are kept, as long as the same card is selected again.
+*/
+void PN5180ISO14443::setActiveCard(ISO14443Card *card) {
+	cardSelected = true;
+	if ((card->uidLength != activeUidLength) || (0 != memcmp(card->uid, activeUid, card->uidLength))) {
+		memcpy(activeUid, card->uid, card->uidLength);
+		activeUidLength = card->uidLength;
+		ntagPages = 0;
+		clearMifareKeyCache();
+	}
+}
+
+/*
+* Select the last activated card again, e.g. after it went to IDLE state
+* on a failed authentication or an unsupported command
+*/
+bool PN5180ISO14443::reselectActiveCard() {
+	ISO14443Card card;
+	card.uidLength = activeUidLength;
+	memcpy(card.uid, activeUid, activeUidLength);
+	return reselect(&card);
+}
+
+/*
+* Enumerate all cards in the field: the first card is activated with WUPA, each
+* activated card is sent to HALT state, so that it does not answer the following
+* REQA anymore. Continues until no more card answers or maxCards are found.
+*
+* cards : array of maxCards entries
+* return value: number of cards found
+*/
+uint8_t PN5180ISO14443::enumerateTypeA(ISO14443Card *cards, uint8_t maxCards) {
+	uint8_t numCards = 0;
+	while (numCards < maxCards) {
+		if (0 == activateTypeA(&cards[numCards], (numCards == 0) ? 1 : 0))
+		  break;
+		mifareHalt();
+		numCards++;
+	}
+	return numCards;
 }
 
 bool PN5180ISO14443::mifareBlockRead(uint8_t blockno, uint8_t *buffer) {
-	bool success = false;
-	uint16_t len;
 	uint8_t cmd[2];
 	// Send mifare command 30,blockno
 	cmd[0] = 0x30;
 	cmd[1] = blockno;
+	clearIRQStatus(0xffffffff);
 	if (!sendData(cmd, 2, 0x00))
 	  return false;
 	//Check if we have received any data from the tag
-	delay(5);
-	len = rxBytesReceived();
-	if (len == 16) {
-		// READ 16 bytes into  buffer
-		if (readData(16, buffer))
-		  success = true;
-	}
-	return success;
+	if (waitForRx(5) != 16)
+	  return false;
+	// READ 16 bytes into  buffer
+	return (readData(16, buffer) != NULL);
 }
 
+/*
+* Wait for the 4 bit ACK/NAK of a write command, RX CRC must be disabled.
+* return value: ACK (0x0A) or NAK code, 0xFF if the card did not answer
+*/
+uint8_t PN5180ISO14443::waitForAck(uint32_t timeout) {
+	uint32_t start = millis();
+	while (0 == (getIRQStatus() & RX_IRQ_STAT)) {
+		if ((uint32_t)(millis() - start) > timeout)
+		  return 0xFF;
+	}
+	uint32_t rxStatus;
+	readRegister(RX_STATUS, &rxStatus);
+	if ((RX_NUM_BYTES_RECEIVED(rxStatus) != 1) || (RX_NUM_LAST_BITS(rxStatus) != 4))
+	  return 0xFF;
+	uint8_t ack;
+	if (!readData(1, &ack))
+	  return 0xFF;
+	return ack & 0x0F;
+}
 
+/*
+* MIFARE write of 16 bytes, in two steps, each acknowledged by the card.
+* return value: ACK (0x0A) or NAK code, 0xFF if the card did not answer
+*/
 uint8_t PN5180ISO14443::mifareBlockWrite16(uint8_t blockno, uint8_t *buffer) {
-	uint8_t cmd[1];
+	uint8_t cmd[2];
+	uint8_t ack;
 	// Clear RX CRC
-	writeRegisterWithAndMask(CRC_RX_CONFIG, 0xFFFFFFFE);
+	writeRegisterWithAndMask(CRC_RX_CONFIG, ~CRC_ENABLE);
 
 	// Mifare write part 1
 	cmd[0] = 0xA0;
 	cmd[1] = blockno;
+	clearIRQStatus(0xffffffff);
 	sendData(cmd, 2, 0x00);
-	readData(1, cmd);
-
-	// Mifare write part 2
-	sendData(buffer,16, 0x00);
-	delay(10);
+	ack = waitForAck(5);
 
-	// Read ACK/NAK
-	readData(1, cmd);
+	// Mifare write part 2, write time of the card is up to 10ms
+	if (ack == 0x0A) {
+		clearIRQStatus(0xffffffff);
+		sendData(buffer, 16, 0x00);
+		ack = waitForAck(10);
+	}
 
 	//Enable RX CRC calculation
-	writeRegisterWithOrMask(CRC_RX_CONFIG, 0x1);
-	return cmd[0];
+	writeRegisterWithOrMask(CRC_RX_CONFIG, CRC_ENABLE);
+	return ack;
 }
 
 bool PN5180ISO14443::mifareHalt() {
-	uint8_t cmd[1];
+	uint8_t cmd[2];
+	cardSelected = false;
 	//mifare Halt
 	cmd[0] = 0x50;
 	cmd[1] = 0x00;
@@ -212,6 +434,556 @@ bool PN5180ISO14443::mifareHalt() {
 	return true;
 }
 
+/*
+* MIFARE Classic memory layout: sectors 0..31 with 4 blocks each, followed by
+* sectors 32..39 with 16 blocks each (MIFARE Classic 4K). The last block of
+* each sector is the sector trailer with the keys and access conditions.
+*/
+uint8_t PN5180ISO14443::mifareSectorOfBlock(uint8_t blockno) {
+	if (blockno < 128)
+	  return blockno / 4;
+	return 32 + (blockno - 128) / 16;
+}
+
+uint8_t PN5180ISO14443::mifareFirstBlockOfSector(uint8_t sector) {
+	if (sector < 32)
+	  return sector * 4;
+	return 128 + (sector - 32) * 16;
+}
+
+void PN5180ISO14443::clearMifareKeyCache() {
+	memset(mfcKeys, 0xFF, sizeof(mfcKeys));
+}
+
+/*
+* Authenticate a sector of the selected MIFARE Classic card. The key, which
+* worked last time for this sector, is tried first. Otherwise all keys are tried
+* as key A, then as key B. After a failed authentication, the card is in IDLE
+* state and is selected again before the next try.
+*
+* keys : list of numKeys keys with 6 bytes each, at most 127 keys
+* return value: true, if the sector is authenticated
+*/
+bool PN5180ISO14443::mifareAuthenticateSector(uint8_t sector, const uint8_t (*keys)[6], uint8_t numKeys) {
+	if ((sector >= ISO14443_MFC_SECTORS) || (activeUidLength == 0) || (numKeys > 127))
+	  return false;
+	if (mfcAuthSector == sector)
+	  return true;
+	// UID CL1 for single size UID, otherwise the last 4 bytes
+	const uint8_t *uid = &activeUid[activeUidLength - 4];
+	uint8_t block = mifareFirstBlockOfSector(sector);
+
+	uint8_t cached = mfcKeys[sector];
+	int16_t numTrials = 2 * numKeys;
+	mfcAuthSector = -1;
+	for (int16_t trial = -1; trial < numTrials; trial++) {
+		uint8_t entry;
+		if (trial < 0) {
+			// cached key first
+			if ((cached == 0xFF) || ((cached & 0x7F) >= numKeys))
+			  continue;
+			entry = cached;
+		}
+		else {
+			entry = (trial < numKeys) ? trial : (0x80 | (trial - numKeys));
+			if (entry == cached)
+			  continue;
+		}
+		uint8_t keyType = (entry & 0x80) ? 0x61 : 0x60;
+		uint8_t status = mifareAuthenticate(block, keyType, keys[entry & 0x7F], uid);
+		if (status == 0x00) {
+			mfcKeys[sector] = entry;
+			mfcAuthSector = sector;
+			return true;
+		}
+		if (status == 0x02) {
+			PN5180DEBUG(F("MIFARE authenticate: no card\n"));
+			break;
+		}
+		if (!reselectActiveCard())
+		  break;
+	}
+	mfcKeys[sector] = 0xFF;
+	mfcAuthSector = -1;
+	return false;
+}
+
+/*
+* Read numBlocks blocks of a MIFARE Classic card, starting at startBlock.
+* The blocks are read sector by sector: each sector is authenticated once,
+* then all its requested blocks are read.
+*
+* buffer : 16 * numBlocks bytes
+* keys : list of numKeys keys with 6 bytes each
+* return value: true, if all blocks were read, false also if startBlock + numBlocks > 256
+*/
+bool PN5180ISO14443::mifareReadBlocks(uint8_t startBlock, uint8_t numBlocks, uint8_t *buffer, const uint8_t (*keys)[6], uint8_t numKeys) {
+	uint16_t block = startBlock;
+	uint16_t endBlock = startBlock + numBlocks;
+	// MIFARE Classic 4K has 256 blocks, there is no block number beyond
+	if (endBlock > 256)
+	  return false;
+	while (block < endBlock) {
+		uint8_t sector = mifareSectorOfBlock(block);
+		if (!mifareAuthenticateSector(sector, keys, numKeys))
+		  return false;
+		uint16_t nextSector = (sector + 1 < ISO14443_MFC_SECTORS) ? mifareFirstBlockOfSector(sector + 1) : 256;
+		for (; (block < endBlock) && (block < nextSector); block++) {
+			if (!mifareBlockRead(block, &buffer[16 * (block - startBlock)]))
+			  return false;
+		}
+	}
+	return true;
+}
+
+/*
+* GET_VERSION of NTAG and MIFARE Ultralight EV1, the response is cached for the
+* selected card. The first MIFARE Ultralight does not support GET_VERSION, and
+* returns to IDLE state, so it is selected again.
+*
+* version : 8 bytes, vendor, product type, storage size etc.
+* return value: true, if the card supports GET_VERSION
+*/
+bool PN5180ISO14443::ntagGetVersion(uint8_t *version) {
+	if (0 == ntagPages) {
+		uint8_t cmd[1];
+		cmd[0] = 0x60;
+		clearIRQStatus(0xffffffff);
+		ntagHasVersion = sendData(cmd, 1, 0x00) && (waitForRx(5) == 8) && readData(8, ntagVersion);
+		if (ntagHasVersion) {
+			// storage size of user memory, plus header and configuration pages
+			switch (ntagVersion[6]) {
+				case 0x0B: ntagPages = 20; break;  // Ultralight EV1 MF0UL11
+				case 0x0E: ntagPages = 41; break;  // Ultralight EV1 MF0UL21
+				case 0x0F: ntagPages = 45; break;  // NTAG213
+				case 0x11: ntagPages = 135; break; // NTAG215
+				case 0x13: ntagPages = 231; break; // NTAG216
+				default:   ntagPages = ((1 << (ntagVersion[6] >> 1)) / 4) + 5; break;
+			}
+		}
+		else {
+			PN5180DEBUG(F("GET_VERSION not supported\n"));
+			ntagPages = 16; // MIFARE Ultralight
+			reselectActiveCard();
+		}
+	}
+	if (!ntagHasVersion)
+	  return false;
+	if (version)
+	  memcpy(version, ntagVersion, sizeof(ntagVersion));
+	return true;
+}
+
+/*
+* Number of pages of the selected NTAG/Ultralight, from the cached GET_VERSION
+*/
+uint8_t PN5180ISO14443::ntagGetNumPages() {
+	ntagGetVersion(NULL);
+	return ntagPages;
+}
+
+/*
+* Read pages startPage..endPage of an NTAG/Ultralight with FAST_READ. Each
+* FAST_READ returns up to ISO14443_FAST_READ_PAGES pages, so a range larger
+* than the RX buffer is read in several exchanges. Cards without GET_VERSION
+* do not support FAST_READ, these are read with READ, 4 pages at a time.
+*
+* buffer : 4 * (endPage - startPage + 1) bytes
+* return value: true, if all pages were read
+*/
+bool PN5180ISO14443::ntagFastRead(uint8_t startPage, uint8_t endPage, uint8_t *buffer) {
+	if ((endPage < startPage) || (endPage >= ntagGetNumPages()))
+	  return false;
+
+	bool fastRead = ntagGetVersion(NULL);
+	uint16_t page = startPage;
+	while (page <= endPage) {
+		uint16_t last = page + ISO14443_FAST_READ_PAGES - 1;
+		if (last > endPage) last = endPage;
+		if (!fastRead) {
+			uint8_t block[16];
+			if (!mifareBlockRead(page, block))
+			  return false;
+			for (uint16_t p = page; (p <= endPage) && (p < page + 4); p++)
+			  memcpy(&buffer[4*(p - startPage)], &block[4*(p - page)], 4);
+			page += 4;
+			continue;
+		}
+		uint8_t cmd[3];
+		cmd[0] = 0x3A;
+		cmd[1] = page;
+		cmd[2] = last;
+		uint16_t len = 4 * (last - page + 1);
+		clearIRQStatus(0xffffffff);
+		if (!sendData(cmd, 3, 0x00))
+		  return false;
+		if (waitForRx(5 + len / 8) != len) // ~1ms per 12 bytes at 106 kbit/s
+		  return false;
+		uint8_t *resp = readData(len);
+		if (!resp)
+		  return false;
+		memcpy(&buffer[4*(page - startPage)], resp, len);
+		page = last + 1;
+	}
+	return true;
+}
+
+/*
+* Write numPages pages of an NTAG/Ultralight with WRITE, starting at startPage.
+* RX CRC is disabled once for all pages, each page is acknowledged by the card,
+* writing stops at the first NAK.
+*
+* data : 4 * numPages bytes
+* return value: number of pages written
+*/
+uint8_t PN5180ISO14443::ntagWritePages(uint8_t startPage, uint8_t numPages, uint8_t *data) {
+	uint8_t maxPages = ntagGetNumPages();
+	if (startPage >= maxPages)
+	  return 0;
+	if (numPages > maxPages - startPage)
+	  numPages = maxPages - startPage;
+
+	// Clear RX CRC, ACK/NAK is a 4 bit frame
+	if (!writeRegisterWithAndMask(CRC_RX_CONFIG, ~CRC_ENABLE))
+	  return 0;
+	uint8_t written = 0;
+	while (written < numPages) {
+		uint8_t cmd[6];
+		cmd[0] = 0xA2;
+		cmd[1] = startPage + written;
+		memcpy(&cmd[2], &data[4*written], 4);
+		clearIRQStatus(0xffffffff);
+		if (!sendData(cmd, 6, 0x00))
+		  break;
+		uint8_t ack = waitForAck(10); // write time is ~4.1ms
+		if (ack != 0x0A) {
+			PN5180DEBUG(F("NTAG write NAK="));
+			PN5180DEBUG(formatHex(ack));
+			PN5180DEBUG("\n");
+			break;
+		}
+		written++;
+	}
+	//Enable RX CRC calculation
+	writeRegisterWithOrMask(CRC_RX_CONFIG, CRC_ENABLE);
+	return written;
+}
+
+/*
+* ISO14443-4 (ISO-DEP)
+*
+* Frame size for the card (FSC) and for the reader (FSD), coded as FSCI/FSDI:
+*   0:16, 1:24, 2:32, 3:40, 4:48, 5:64, 6:96, 7:128, 8:256 bytes
+* The frame size includes PCB and CRC. No CID and no NAD are used.
+*/
+static const uint16_t isoDepFrameSizes[] = { 16, 24, 32, 40, 48, 64, 96, 128, 256 };
+
+/*
+* Wait for the end of reception, at most timeout milliseconds.
+* return value: number of bytes received, zero on timeout or error
+*/
+uint16_t PN5180ISO14443::waitForRx(uint32_t timeout) {
+	uint32_t start = millis();
+	while (0 == (getIRQStatus() & RX_IRQ_STAT)) {
+		if ((uint32_t)(millis() - start) > timeout)
+		  return 0;
+	}
+	uint32_t rxStatus;
+	readRegister(RX_STATUS, &rxStatus);
+	if (rxStatus & (RX_DATA_INTEGRITY_ERROR | RX_PROTOCOL_ERROR | RX_COLLISION_DETECTED))
+	  return 0;
+	return (uint16_t)(rxStatus & 0x000001ff);
+}
+
+/*
+* Frame waiting time in milliseconds: FWT = 256 * 16 / fc * 2^FWI, plus a margin
+* for the SPI host interface
+*/
+uint32_t PN5180ISO14443::isoDepFWT() {
+	return ((302UL << isoDepFWI) / 1000) + 10;
+}
+
+/*
+* RATS - Request for answer to select, the card must be selected with a SAK,
+* that indicates ISO14443-4 compliance (bit 6).
+*
+* ats : receives the ATS, starting with TL
+* maxLen : size of ats buffer
+* return value: length of ATS, zero if the card did not answer
+*/
+uint8_t PN5180ISO14443::rats(uint8_t *ats, uint8_t maxLen) {
+	uint8_t cmd[2];
+	isoDepActive = false;
+	cmd[0] = 0xE0;
+	cmd[1] = (ISO14443_FSDI << 4); // FSDI, CID=0
+	clearIRQStatus(0xffffffff);
+	if (!sendData(cmd, 2, 0x00))
+	  return 0;
+	uint16_t len = waitForRx(5); // FWT for RATS is ~5ms
+	if ((len == 0) || (len > maxLen))
+	  return 0;
+	uint8_t *resp = readData(len);
+	if (!resp)
+	  return 0;
+	for (int i = 0; i < len; i++) ats[i] = resp[i];
+	if (ats[0] != len)
+	  return 0;
+
+	// defaults, if interface bytes are missing
+	uint8_t fsci = 2;
+	uint8_t sfgi = 0;
+	isoDepFWI = 4;
+	isoDepTA = 0x00;
+	if (len > 1) {
+		uint8_t t0 = ats[1];
+		uint8_t *p = &ats[2];
+		fsci = t0 & 0x0f;
+		if (t0 & 0x10) isoDepTA = *p++;
+		if (t0 & 0x20) {
+			isoDepFWI = (*p >> 4) & 0x0f;
+			sfgi = *p++ & 0x0f;
+		}
+	}
+	if (fsci > 8) fsci = 8;
+	if (isoDepFWI > 14) isoDepFWI = 4;
+	isoDepFSC = isoDepFrameSizes[fsci];
+	isoDepBlockNumber = 0;
+	isoDepActive = true;
+
+	PN5180DEBUG(F("ATS: FSC="));
+	PN5180DEBUG(isoDepFSC);
+	PN5180DEBUG(F(", FWI="));
+	PN5180DEBUG(isoDepFWI);
+	PN5180DEBUG(F(", TA="));
+	PN5180DEBUG(formatHex(isoDepTA));
+	PN5180DEBUG("\n");
+
+	// start-up frame guard time SFGT = 256 * 16 / fc * 2^SFGI
+	if ((sfgi > 0) && (sfgi < 15))
+	  delay(((302UL << sfgi) / 1000) + 1);
+	return len;
+}
+
+/*
+* PPS - Protocol and parameter selection, switches the bit rates
+* dsi : divisor card to reader, dri : divisor reader to card
+*   0:106, 1:212, 2:424, 3:848 kbit/s
+* After the response of the card, the RF configuration of the matching
+* bit rate is loaded: TX 0x00+dri, RX 0x80+dsi
+*/
+bool PN5180ISO14443::pps(uint8_t dsi, uint8_t dri) {
+	uint8_t cmd[3];
+	cmd[0] = 0xD0;                       // PPSS, CID=0
+	cmd[1] = 0x11;                       // PPS0, PPS1 is present
+	cmd[2] = ((dsi & 0x03) << 2) | (dri & 0x03); // PPS1
+	clearIRQStatus(0xffffffff);
+	if (!sendData(cmd, 3, 0x00))
+	  return false;
+	uint16_t len = waitForRx(isoDepFWT());
+	if (len != 1)
+	  return false;
+	uint8_t *resp = readData(1);
+	if (!resp || (resp[0] != 0xD0))
+	  return false;
+
+	PN5180DEBUG(F("PPS: DSI="));
+	PN5180DEBUG(dsi);
+	PN5180DEBUG(F(", DRI="));
+	PN5180DEBUG(dri);
+	PN5180DEBUG("\n");
+
+	if (!loadRFConfig(0x00 + dri, 0x80 + dsi))
+	  return false;
+	// CRC is required in all ISO-DEP frames
+	if (!writeRegisterWithOrMask(CRC_RX_CONFIG, CRC_ENABLE))
+	  return false;
+	if (!writeRegisterWithOrMask(CRC_TX_CONFIG, CRC_ENABLE))
+	  return false;
+	return true;
+}
+
+/*
+* Activate ISO-DEP on the selected card: RATS, then PPS to the highest
+* bit rate supported by card and reader, limited by maxBitRate.
+* maxBitRate : 0:106, 1:212, 2:424, 3:848 kbit/s
+* return value: true, if ISO-DEP is active
+*/
+bool PN5180ISO14443::activateISODEP(uint8_t maxBitRate) {
+	uint8_t ats[32];
+	if (0 == rats(ats, sizeof(ats)))
+	  return false;
+
+	// TA(1): b8 same divisor only, b7..b5 DS (card to reader), b3..b1 DR (reader to card)
+	uint8_t ds = 0, dr = 0;
+	for (uint8_t d = 1; d <= 3 && d <= maxBitRate; d++) {
+		if (isoDepTA & (0x08 << d)) ds = d;
+		if (isoDepTA & (0x01 << (d-1))) dr = d;
+	}
+	if (isoDepTA & 0x80) { // same bit rate in both directions
+		ds = dr = (ds < dr) ? ds : dr;
+	}
+	if ((ds == 0) && (dr == 0))
+	  return true; // stay at 106 kbit/s, PPS is not required
+	if (!pps(ds, dr)) {
+		isoDepActive = false;
+		return false;
+	}
+	return true;
+}
+
+/*
+* Receive one block from the card. Waiting time extension requests S(WTX) are
+* answered, and the frame waiting time is extended by WTXM for the next block.
+* resp : receives a pointer to the block, valid until the next readData
+* return value: length of the block, zero on timeout or error
+*/
+uint16_t PN5180ISO14443::isoDepReceive(uint8_t **resp) {
+	uint32_t timeout = isoDepFWT();
+	while (true) {
+		uint16_t rxLen = waitForRx(timeout);
+		if (rxLen == 0)
+		  return 0;
+		*resp = readData(rxLen);
+		if (!*resp)
+		  return 0;
+		if ((((*resp)[0] & 0xF7) != 0xF2) || (rxLen < 2))
+		  return rxLen;
+		// S(WTX) request, answer with same WTXM
+		uint8_t wtx[2];
+		wtx[0] = 0xF2;
+		wtx[1] = (*resp)[1] & 0x3F;
+		PN5180DEBUG(F("ISO-DEP: WTX, WTXM="));
+		PN5180DEBUG(wtx[1]);
+		PN5180DEBUG("\n");
+		timeout = isoDepFWT() * ((wtx[1] > 0) ? wtx[1] : 1);
+		clearIRQStatus(0xffffffff);
+		if (!sendData(wtx, 2, 0x00))
+		  return 0;
+	}
+}
+
+/*
+* Build the SPI frame of the next I-block: frame[0..1] are reserved for
+* sendDataFrame, followed by PCB and up to maxInf bytes of data.
+* The chaining bit is set, if more data follows.
+* return value: length of PCB and INF
+*/
+static uint16_t buildIBlock(uint8_t *frame, uint8_t blockNumber, uint8_t *data, uint16_t len, uint16_t *pos, uint16_t maxInf) {
+	uint16_t inf = len - *pos;
+	uint8_t pcb = 0x02 | blockNumber;
+	if (inf > maxInf) {
+		inf = maxInf;
+		pcb |= 0x10; // chaining
+	}
+	frame[2] = pcb;
+	for (uint16_t i = 0; i < inf; i++) frame[3+i] = data[(*pos)++];
+	return inf + 1;
+}
+
+/*
+* Exchange of an APDU with the card. Data larger than the frame size of the card
+* is sent in chained I-blocks, each acknowledged by an R(ACK). A chained response
+* is acknowledged with R(ACK) block by block, until the last I-block.
+* The SPI frame of the next I-block is prepared, while the current one is still
+* being transmitted by the PN5180.
+* return value: number of bytes received, -1 on error
+*/
+int16_t PN5180ISO14443::isoDepTransceive(uint8_t *data, uint16_t len, uint8_t *response, uint16_t maxLen) {
+	if (!isoDepActive)
+	  return -1;
+	uint32_t start = millis();
+
+	// frame: SEND_DATA header (2), PCB (1), INF; CRC (2) is added by the PN5180
+	uint16_t frameSize = (isoDepFSC < ISO14443_TX_FRAME_SIZE) ? isoDepFSC : ISO14443_TX_FRAME_SIZE;
+	uint16_t maxInf = frameSize - 3;
+	uint8_t frames[2][2 + ISO14443_TX_FRAME_SIZE];
+	uint8_t current = 0;
+	uint16_t pos = 0;
+	uint16_t frameLen = buildIBlock(frames[current], isoDepBlockNumber, data, len, &pos, maxInf);
+
+	uint8_t *resp;
+	uint16_t rxLen;
+	while (true) {
+		bool chaining = (frames[current][2] & 0x10) != 0;
+		clearIRQStatus(0xffffffff);
+		if (!sendDataFrame(frames[current], frameLen, 0x00))
+		  return -1;
+		// prepare next block, while the current one is transmitted
+		uint16_t nextLen = 0;
+		if (chaining)
+		  nextLen = buildIBlock(frames[current ^ 1], isoDepBlockNumber ^ 1, data, len, &pos, maxInf);
+
+		rxLen = isoDepReceive(&resp);
+		if (rxLen == 0)
+		  return -1;
+		if (!chaining)
+		  break;
+		// R(ACK) with current block number expected
+		if (((resp[0] & 0xF6) != 0xA2) || ((resp[0] & 0x01) != isoDepBlockNumber)) {
+			PN5180DEBUG(F("ISO-DEP: expected R(ACK), PCB="));
+			PN5180DEBUG(formatHex(resp[0]));
+			PN5180DEBUG("\n");
+			return -1;
+		}
+		isoDepBlockNumber ^= 1;
+		current ^= 1;
+		frameLen = nextLen;
+	}
+
+	uint16_t received = 0;
+	while (true) {
+		uint8_t pcb = resp[0];
+		if (((pcb & 0xE2) != 0x02) || ((pcb & 0x01) != isoDepBlockNumber)) {
+			PN5180DEBUG(F("ISO-DEP: unexpected PCB="));
+			PN5180DEBUG(formatHex(pcb));
+			PN5180DEBUG("\n");
+			return -1;
+		}
+		isoDepBlockNumber ^= 1;
+		if (received + rxLen - 1 > maxLen)
+		  return -1;
+		for (uint16_t i = 1; i < rxLen; i++) response[received++] = resp[i];
+		if (0 == (pcb & 0x10))
+		  break;
+		// acknowledge chained I-block
+		uint8_t ack[1];
+		ack[0] = 0xA2 | isoDepBlockNumber;
+		clearIRQStatus(0xffffffff);
+		if (!sendData(ack, 1, 0x00))
+		  return -1;
+		rxLen = isoDepReceive(&resp);
+		if (rxLen == 0)
+		  return -1;
+	}
+
+	isoDepBytes += len + received;
+	isoDepTime += millis() - start;
+	return received;
+}
+
+/*
+* Throughput of all isoDepTransceive calls, APDU bytes sent and received per second
+*/
+uint32_t PN5180ISO14443::getIsoDepThroughput() {
+	if (isoDepTime == 0)
+	  return 0;
+	return (isoDepBytes * 1000UL) / isoDepTime;
+}
+
+/*
+* DESELECT, ends the ISO-DEP session, the card enters HALT state
+*/
+bool PN5180ISO14443::deselect() {
+	uint8_t cmd[1];
+	cmd[0] = 0xC2; // S(DESELECT)
+	isoDepActive = false;
+	cardSelected = false;
+	clearIRQStatus(0xffffffff);
+	if (!sendData(cmd, 1, 0x00))
+	  return false;
+	return (waitForRx(isoDepFWT()) == 1);
+}
+
 uint8_t PN5180ISO14443::readCardSerial(uint8_t *buffer) {
   
     uint8_t response[10];
@@ -240,3 +1012,59 @@ bool PN5180ISO14443::isCardPresent() {
 	return (readCardSerial(buffer) >=4);
 }
 
+/*
+* Presence check, that keeps the card selected. If card is the selected card,
+* it is confirmed with the cheapest exchange for its type:
+* - ISO-DEP: R(NAK), answered by R(ACK)
+* - MIFARE Classic: READ of a block in the authenticated sector
+* - NTAG/Ultralight: READ of page 0
+* If the card does not answer, or there is no such exchange for it, the card is
+* selected again with its known UID. Only if this fails as well, a full activation
+* is done, which succeeds only, if it finds the same card.
+*
+* card : the card to check, receives ATQA and SAK of the activation
+* return value: true, if this card is selected
+*/
+bool PN5180ISO14443::isCardPresent(ISO14443Card *card) {
+	bool known = cardSelected && (card->uidLength == activeUidLength) &&
+	             (0 == memcmp(card->uid, activeUid, activeUidLength));
+	if (known) {
+		uint8_t cmd[2];
+		uint8_t block[16];
+		if (isoDepActive) {
+			cmd[0] = 0xB2 | isoDepBlockNumber; // R(NAK)
+			clearIRQStatus(0xffffffff);
+			if (sendData(cmd, 1, 0x00) && (waitForRx(isoDepFWT()) == 1)) {
+				uint8_t *resp = readData(1);
+				if (resp && ((resp[0] & 0xF6) == 0xA2))
+				  return true;
+			}
+		}
+		else if (mfcAuthSector >= 0) {
+			if (mifareBlockRead(mifareFirstBlockOfSector(mfcAuthSector), block))
+			  return true;
+		}
+		else if ((card->sak & 0x7F) == 0x00) {
+			if (mifareBlockRead(0, block))
+			  return true;
+		}
+		else {
+			mifareHalt();
+		}
+
+		bool isoDep = isoDepActive;
+		if (reselect(card)) {
+			if (!isoDep || activateISODEP())
+			  return true;
+		}
+		PN5180DEBUG(F("Card lost\n"));
+	}
+
+	ISO14443Card found;
+	if (activateTypeA(&found, 1) < 4)
+	  return false;
+	if ((found.uidLength != card->uidLength) || (0 != memcmp(found.uid, card->uid, card->uidLength)))
+	  return false;
+	*card = found;
+	return true;
+}
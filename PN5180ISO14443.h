@@ -21,26 +21,104 @@
 
 #include "PN5180.h"
 
+// Frame size for the reader, FSDI=8: 256 bytes
+#define ISO14443_FSDI   (8)
+
+// Max. size of a transmitted ISO-DEP frame, two frames are kept on the stack
+#ifndef ISO14443_TX_FRAME_SIZE
+#if defined(__AVR__)
+#define ISO14443_TX_FRAME_SIZE  (64)
+#else
+#define ISO14443_TX_FRAME_SIZE  (256)
+#endif
+#endif
+
+// Max. pages of one FAST_READ, the response must fit into the 508 bytes RX buffer
+#define ISO14443_FAST_READ_PAGES  (127)
+
+// Max. number of MIFARE Classic sectors, 40 for MIFARE Classic 4K
+#define ISO14443_MFC_SECTORS  (40)
+
+struct ISO14443Card {
+  uint8_t atqa[2];
+  uint8_t sak;
+  uint8_t uidLength;          // 4, 7 or 10
+  uint8_t uid[10];
+  uint8_t anticollisionLoops; // number of ANTICOLLISION frames sent
+};
+
 class PN5180ISO14443 : public PN5180 {
 
 public:
   PN5180ISO14443(uint8_t SSpin, uint8_t BUSYpin, uint8_t RSTpin);
   
 private:
+  // ISO14443-4 (ISO-DEP) session
+  bool isoDepActive;
+  uint16_t isoDepFSC;        // max. frame size of card
+  uint8_t isoDepFWI;         // frame waiting time integer
+  uint8_t isoDepTA;          // supported bit rates, TA(1) of ATS
+  uint8_t isoDepBlockNumber;
+  uint32_t isoDepBytes;      // APDU bytes sent and received
+  uint32_t isoDepTime;       // milliseconds spent in isoDepTransceive
+  // NTAG/Ultralight GET_VERSION of the last activated card
+  uint8_t activeUid[10];
+  uint8_t activeUidLength;
+  uint8_t ntagVersion[8];
+  bool ntagHasVersion;
+  uint8_t ntagPages;         // zero, if GET_VERSION was not sent yet
+  // MIFARE Classic key of each sector of the last activated card:
+  // bit 7 set for key B, bits 0..6 index in key list, 0xFF if unknown
+  uint8_t mfcKeys[ISO14443_MFC_SECTORS];
+  int8_t mfcAuthSector;      // authenticated sector, -1 if none
+  bool cardSelected;         // last activated card is in ACTIVE state
+
   uint16_t rxBytesReceived();
+  uint16_t waitForRx(uint32_t timeout);
+  uint32_t isoDepFWT();
+  uint16_t isoDepReceive(uint8_t **resp);
+  bool anticollision(uint8_t sel, uint8_t *uidCL, uint8_t *loops);
+  bool select(uint8_t sel, uint8_t *uidCL, uint8_t *sak);
+  bool enableCRC();
+  void setActiveCard(ISO14443Card *card);
+  uint8_t waitForAck(uint32_t timeout);
+  bool reselectActiveCard();
 public:
   // Mifare TypeA
   uint8_t activateTypeA(uint8_t *buffer, uint8_t kind);
+  uint8_t activateTypeA(ISO14443Card *card, uint8_t kind);
+  uint8_t enumerateTypeA(ISO14443Card *cards, uint8_t maxCards);
+  bool reselect(ISO14443Card *card);
   bool mifareBlockRead(uint8_t blockno,uint8_t *buffer);
   uint8_t mifareBlockWrite16(uint8_t blockno, uint8_t *buffer);
   bool mifareHalt();
+  // MIFARE Classic
+  static uint8_t mifareSectorOfBlock(uint8_t blockno);
+  static uint8_t mifareFirstBlockOfSector(uint8_t sector);
+  bool mifareAuthenticateSector(uint8_t sector, const uint8_t (*keys)[6], uint8_t numKeys);
+  bool mifareReadBlocks(uint8_t startBlock, uint8_t numBlocks, uint8_t *buffer, const uint8_t (*keys)[6], uint8_t numKeys);
+  void clearMifareKeyCache();
+  // NTAG/Ultralight
+  bool ntagGetVersion(uint8_t *version);
+  uint8_t ntagGetNumPages();
+  bool ntagFastRead(uint8_t startPage, uint8_t endPage, uint8_t *buffer);
+  uint8_t ntagWritePages(uint8_t startPage, uint8_t numPages, uint8_t *data);
+  // ISO14443-4 (ISO-DEP)
+  uint8_t rats(uint8_t *ats, uint8_t maxLen);
+  bool pps(uint8_t dsi, uint8_t dri);
+  bool activateISODEP(uint8_t maxBitRate = 3);
+  int16_t isoDepTransceive(uint8_t *data, uint16_t len, uint8_t *response, uint16_t maxLen);
+  bool deselect();
+  uint32_t getIsoDepThroughput();
   /*
    * Helper functions
    */
 public:   
   bool setupRF();
+  bool loadProtocolConfig();
   uint8_t readCardSerial(uint8_t *buffer);    
-  bool isCardPresent();    
+  bool isCardPresent();
+  bool isCardPresent(ISO14443Card *card);
 };
 
 #endif /* PN5180ISO14443_H */
@@ -20,10 +20,12 @@
 
 #include <Arduino.h>
 #include "PN5180ISO15693.h"
+#include "PN5180Profile.h"
 #include "Debug.h"
 
 PN5180ISO15693::PN5180ISO15693(uint8_t SSpin, uint8_t BUSYpin, uint8_t RSTpin)
               : PN5180(SSpin, BUSYpin, RSTpin) {
+  clearSystemInfoCache();
 }
 
 /*
@@ -34,10 +36,26 @@ PN5180ISO15693::PN5180ISO15693(uint8_t SSpin, uint8_t BUSYpin, uint8_t RSTpin)
  *
  */
 ISO15693ErrorCode PN5180ISO15693::getInventory(uint8_t *uid) {
-  //                     Flags,  CMD, maskLen
-  uint8_t inventory[] = { 0x26, 0x01, 0x00 };
-  //                        |\- inventory flag + high data rate
-  //                        \-- 1 slot: only one card, no AFI field present
+  return getInventory(uid, 0x00, 0, NULL);
+}
+
+/*
+ * Inventory with AFI and mask, code=01
+ *
+ * afi : application family identifier, 0x00 selects all families, no AFI field is sent
+ * maskLen : number of UID bits in mask, 0-64
+ * mask : the least significant UID bits to match, LSB first
+ */
+ISO15693ErrorCode PN5180ISO15693::getInventory(uint8_t *uid, uint8_t afi, uint8_t maskLen, uint8_t *mask) {
+  if (maskLen > 64) {
+    return ISO15693_EC_OPTION_NOT_SUPPORTED;
+  }
+
+  //                Flags,  CMD, AFI (opt.), maskLen, mask (opt.)
+  uint8_t inventory[12];
+  uint8_t inventoryLen = buildInventoryRequest(inventory, 0x26, afi, maskLen, mask);
+  //                                                        |\- inventory flag + high data rate
+  //                                                        \-- 1 slot: only one card
   PN5180DEBUG(F("Get Inventory...\n"));
 
   for (int i=0; i<8; i++) {
@@ -45,7 +63,7 @@ ISO15693ErrorCode PN5180ISO15693::getInventory(uint8_t *uid) {
   }
 
   uint8_t *readBuffer;
-  ISO15693ErrorCode rc = issueISO15693Command(inventory, sizeof(inventory), &readBuffer);
+  ISO15693ErrorCode rc = issueISO15693Command(inventory, inventoryLen, &readBuffer);
   if (ISO15693_EC_OK != rc) {
     return rc;
   }
@@ -69,6 +87,209 @@ ISO15693ErrorCode PN5180ISO15693::getInventory(uint8_t *uid) {
   return ISO15693_EC_OK;
 }
 
+/*
+ * Inventory with 16 slots, code=01
+ *
+ * Request format: SOF, Req.Flags, Inventory, AFI (opt.), Mask len, Mask value, CRC16, EOF
+ * Response format (per slot): SOF, Resp.Flags, DSFID, UID, CRC16, EOF
+ *
+ * uids : must be an array of maxTags*8 bytes, each UID with LSB first
+ * numTags : number of labels found in this round
+ *
+ * Labels, whose responses collided in a slot, are not reported.
+ */
+ISO15693ErrorCode PN5180ISO15693::getInventoryMultiple(uint8_t *uids, uint8_t maxTags, uint8_t *numTags) {
+  uint16_t collisions;
+  return getInventoryMultiple(uids, maxTags, numTags, 0x00, 0, NULL, &collisions);
+}
+
+/*
+ * Inventory with 16 slots, AFI and mask, code=01
+ *
+ * afi : application family identifier, 0x00 selects all families, no AFI field is sent
+ * maskLen : number of UID bits in mask, 0-60
+ * mask : the least significant UID bits to match, LSB first
+ * collisions : bit n is set, if the responses in slot n collided
+ *
+ * A label answers in the slot given by the 4 UID bits following the mask. So all labels
+ * of a collided slot n can be separated by repeating the inventory with the mask extended
+ * by n, see getInventoryPartitioned.
+ */
+ISO15693ErrorCode PN5180ISO15693::getInventoryMultiple(uint8_t *uids, uint8_t maxTags, uint8_t *numTags,
+                                                       uint8_t afi, uint8_t maskLen, uint8_t *mask, uint16_t *collisions) {
+  if (maskLen > 60) {
+    return ISO15693_EC_OPTION_NOT_SUPPORTED;
+  }
+
+  //                Flags,  CMD, AFI (opt.), maskLen, mask (opt.)
+  uint8_t inventory[12];
+  uint8_t inventoryLen = buildInventoryRequest(inventory, 0x06, afi, maskLen, mask);
+  //                                                        |\- inventory flag + high data rate
+  //                                                        \-- 16 slots
+  PN5180DEBUG(F("Get Inventory (16 slots)...\n"));
+
+  return inventoryRound(inventory, inventoryLen, maskLen, mask, 0, uids, NULL, maxTags, numTags, collisions);
+}
+
+/*
+ * Inventory of large label populations, code=01
+ *
+ * Starts with a 16 slot inventory over the whole UID space. Each slot with a collision
+ * is resolved by a new round, whose mask is extended by the 4 bits of the slot number.
+ * So only the part of the UID space, where labels actually collide, is split further,
+ * and each round has fewer labels competing for the 16 slots.
+ *
+ * uids : must be an array of maxTags*8 bytes, each UID with LSB first
+ * numTags : number of labels found in all rounds
+ * numRounds : number of inventory rounds needed (opt.)
+ */
+ISO15693ErrorCode PN5180ISO15693::getInventoryPartitioned(uint8_t *uids, uint8_t maxTags, uint8_t *numTags,
+                                                          uint8_t afi, uint8_t *numRounds) {
+  struct {
+    uint8_t maskLen;
+    uint8_t mask[8];
+  } partitions[ISO15693_MAX_PARTITIONS];
+  uint8_t numPartitions = 0;
+  uint8_t rounds = 0;
+
+  *numTags = 0;
+  partitions[numPartitions].maskLen = 0;
+  for (int i=0; i<8; i++) partitions[numPartitions].mask[i] = 0;
+  numPartitions++;
+
+  PN5180DEBUG(F("Get Inventory (partitioned)...\n"));
+
+  while ((numPartitions > 0) && (*numTags < maxTags)) {
+    numPartitions--;
+    uint8_t maskLen = partitions[numPartitions].maskLen;
+    uint8_t mask[8];
+    for (int i=0; i<8; i++) mask[i] = partitions[numPartitions].mask[i];
+
+    uint8_t found = 0;
+    uint16_t collisions = 0;
+    ISO15693ErrorCode rc = getInventoryMultiple(&uids[8 * (*numTags)], maxTags - *numTags, &found,
+                                                afi, maskLen, mask, &collisions);
+    rounds++;
+    if ((ISO15693_EC_OK != rc) && (EC_NO_CARD != rc)) {
+      if (numRounds) *numRounds = rounds;
+      return rc;
+    }
+    *numTags += found;
+
+    // split collided slots by extending the mask with the slot number
+    for (uint8_t slot=0; slot<16; slot++) {
+      if (0 == (collisions & (1 << slot))) continue;
+      if ((maskLen + 4 > 60) || (numPartitions >= ISO15693_MAX_PARTITIONS)) {
+        PN5180DEBUG(F("Unresolved collision in slot "));
+        PN5180DEBUG(slot);
+        PN5180DEBUG("\n");
+        continue;
+      }
+      partitions[numPartitions].maskLen = maskLen + 4;
+      for (int i=0; i<8; i++) partitions[numPartitions].mask[i] = mask[i];
+      if (maskLen % 8) partitions[numPartitions].mask[maskLen / 8] |= (slot << 4);
+      else partitions[numPartitions].mask[maskLen / 8] = slot;
+      numPartitions++;
+    }
+  }
+
+  if (numRounds) *numRounds = rounds;
+
+  PN5180DEBUG(F("Partitioned inventory: tags="));
+  PN5180DEBUG(*numTags);
+  PN5180DEBUG(F(", rounds="));
+  PN5180DEBUG(rounds);
+  PN5180DEBUG("\n");
+
+  return (0 < *numTags) ? ISO15693_EC_OK : EC_NO_CARD;
+}
+
+/*
+ * Build the request of an inventory command, code=01
+ *
+ * Request format: Req.Flags, Inventory, AFI (opt.), Mask len, Mask value
+ * The AFI flag is set, if afi is not 0x00. The mask value is sent with the
+ * minimum number of bytes, unused bits in the last byte are cleared.
+ *
+ * return value: the length of the request, max. 12 bytes
+ */
+uint8_t PN5180ISO15693::buildInventoryRequest(uint8_t *cmd, uint8_t flags, uint8_t afi, uint8_t maskLen, uint8_t *mask) {
+  uint8_t pos = 0;
+  cmd[pos++] = (0x00 != afi) ? (flags | 0x10) : flags;
+  cmd[pos++] = 0x01;
+  if (0x00 != afi) {
+    cmd[pos++] = afi;
+  }
+  cmd[pos++] = maskLen;
+  uint8_t maskBytes = (maskLen + 7) / 8;
+  for (int i=0; i<maskBytes; i++) {
+    cmd[pos++] = mask[i];
+  }
+  if (maskLen % 8) {
+    cmd[pos-1] &= (1 << (maskLen % 8)) - 1;
+  }
+  return pos;
+}
+
+/*
+ * Stay quiet, code=02
+ *
+ * Request format: SOF, Req.Flags, StayQuiet, UID, CRC16, EOF
+ * Response format: no response
+ *
+ * The label enters the quiet state and does not answer inventory requests anymore,
+ * until it receives a RESET TO READY or a SELECT, or the RF field is switched off.
+ * Addressed commands are still processed in quiet state.
+ */
+ISO15693ErrorCode PN5180ISO15693::stayQuiet(uint8_t *uid) {
+  //                      flags, cmd, uid
+  uint8_t stayQuiet[] = { 0x22, 0x02, 1,2,3,4,5,6,7,8 }; // UID has LSB first!
+  //                        |\- high data rate
+  //                        \-- no options, addressed by UID
+  for (int i=0; i<8; i++) {
+    stayQuiet[2+i] = uid[i];
+  }
+
+  PN5180DEBUG(F("Stay Quiet...\n"));
+
+  if (!setRxFastMode(false)) {
+    return ISO15693_EC_UNKNOWN_ERROR;
+  }
+
+  clearIRQStatus(0xffffffff);
+  if (!sendData(stayQuiet, sizeof(stayQuiet))) {
+    return ISO15693_EC_UNKNOWN_ERROR;
+  }
+  while (0 == (TX_IRQ_STAT & getIRQStatus())); // no response, wait for end of transmission
+  clearIRQStatus(0xffffffff);
+
+  return ISO15693_EC_OK;
+}
+
+/*
+ * Reset to ready, code=26
+ *
+ * Request format: SOF, Req.Flags, ResetToReady, UID (opt.), CRC16, EOF
+ * Response format: SOF, Resp.Flags, CRC16, EOF
+ *
+ * Returns a label from quiet state into ready state. Since the request is addressed,
+ * the response also confirms, that the label is still in the field.
+ */
+ISO15693ErrorCode PN5180ISO15693::resetToReady(uint8_t *uid) {
+  //                         flags, cmd, uid
+  uint8_t resetToReady[] = { 0x22, 0x26, 1,2,3,4,5,6,7,8 }; // UID has LSB first!
+  //                           |\- high data rate
+  //                           \-- no options, addressed by UID
+  for (int i=0; i<8; i++) {
+    resetToReady[2+i] = uid[i];
+  }
+
+  PN5180DEBUG(F("Reset to Ready...\n"));
+
+  uint8_t *resultPtr;
+  return issueISO15693Command(resetToReady, sizeof(resetToReady), &resultPtr);
+}
+
 /*
  * Read single block, code=20
  *
@@ -221,6 +442,171 @@ ISO15693ErrorCode PN5180ISO15693::writeSingleBlock(uint8_t *uid, uint8_t blockNo
   return ISO15693_EC_OK;
 }
 
+/*
+ * Read multiple blocks, code=23
+ *
+ * Request format: SOF, Req.Flags, ReadMultipleBlocks, UID (opt.), FirstBlockNumber, NumBlocks-1, CRC16, EOF
+ * Response format:
+ *  when ERROR flag is set:
+ *    SOF, Resp.Flags, ErrorCode, CRC16, EOF
+ *
+ *  when ERROR flag is NOT set:
+ *    SOF, Flags, BlockData (len=numBlocks*blockLength), CRC16, EOF
+ *
+ * The whole response must fit into the 508 byte reception buffer of the PN5180.
+ */
+ISO15693ErrorCode PN5180ISO15693::readMultipleBlocks(uint8_t *uid, uint8_t blockNo, uint8_t numBlocks, uint8_t *blockData, uint8_t blockSize) {
+  if ((0 == numBlocks) || ((1 + numBlocks * blockSize) > 508)) {
+    PN5180DEBUG(F("ERROR: Number of blocks exceeds reception buffer!\n"));
+    return ISO15693_EC_OPTION_NOT_SUPPORTED;
+  }
+
+  //                             flags, cmd, uid,             blockNo, numBlocks-1
+  uint8_t readMultipleBlocks[] = { 0x22, 0x23, 1,2,3,4,5,6,7,8, blockNo, (uint8_t)(numBlocks-1) }; // UID has LSB first!
+  //                                 |\- high data rate
+  //                                 \-- no options, addressed by UID
+  for (int i=0; i<8; i++) {
+    readMultipleBlocks[2+i] = uid[i];
+  }
+
+  PN5180DEBUG(F("Read Multiple Blocks #"));
+  PN5180DEBUG(blockNo);
+  PN5180DEBUG(F(", count="));
+  PN5180DEBUG(numBlocks);
+  PN5180DEBUG("\n");
+
+  uint8_t *resultPtr;
+  uint16_t len;
+  ISO15693ErrorCode rc = issueISO15693Command(readMultipleBlocks, sizeof(readMultipleBlocks), &resultPtr, &len);
+  if (ISO15693_EC_OK != rc) {
+    return rc;
+  }
+  // flags and block data
+  if (len < 1 + numBlocks*blockSize) {
+    return ISO15693_EC_UNKNOWN_ERROR;
+  }
+
+  for (int i=0; i<numBlocks*blockSize; i++) {
+    blockData[i] = resultPtr[1+i];
+  }
+
+  return ISO15693_EC_OK;
+}
+
+/*
+ * Extended read single block, code=30
+ *
+ * Request format: SOF, Req.Flags, ExtReadSingleBlock, UID (opt.), BlockNumber (2 bytes, LSB first), CRC16, EOF
+ * Response format: same as READ SINGLE BLOCK
+ *
+ * For labels with 2 bytes memory addressing, i.e. more than 256 blocks, see
+ * ISO15693SystemInfo::extendedAddressing.
+ */
+ISO15693ErrorCode PN5180ISO15693::extendedReadSingleBlock(uint8_t *uid, uint16_t blockNo, uint8_t *blockData, uint8_t blockSize) {
+  //                               flags, cmd, uid,             blockNo
+  uint8_t extReadSingleBlock[] = { 0x22, 0x30, 1,2,3,4,5,6,7,8, (uint8_t)(blockNo & 0xff), (uint8_t)(blockNo >> 8) }; // UID has LSB first!
+  for (int i=0; i<8; i++) {
+    extReadSingleBlock[2+i] = uid[i];
+  }
+
+  PN5180DEBUG(F("Extended Read Single Block #"));
+  PN5180DEBUG(blockNo);
+  PN5180DEBUG("\n");
+
+  uint8_t *resultPtr;
+  uint16_t len;
+  ISO15693ErrorCode rc = issueISO15693Command(extReadSingleBlock, sizeof(extReadSingleBlock), &resultPtr, &len);
+  if (ISO15693_EC_OK != rc) {
+    return rc;
+  }
+  // flags and block data
+  if (len < 1 + blockSize) {
+    return ISO15693_EC_UNKNOWN_ERROR;
+  }
+
+  for (int i=0; i<blockSize; i++) {
+    blockData[i] = resultPtr[1+i];
+  }
+
+  return ISO15693_EC_OK;
+}
+
+/*
+ * Extended write single block, code=31
+ *
+ * Request format: SOF, Req.Flags, ExtWriteSingleBlock, UID (opt.), BlockNumber (2 bytes, LSB first), BlockData, CRC16, EOF
+ * Response format: same as WRITE SINGLE BLOCK
+ */
+ISO15693ErrorCode PN5180ISO15693::extendedWriteSingleBlock(uint8_t *uid, uint16_t blockNo, uint8_t *blockData, uint8_t blockSize) {
+  //                 flags, cmd, uid, blockNo (2 bytes), blockData
+  uint8_t extWriteCmd[12+32];
+  if (blockSize > 32) {
+    return ISO15693_EC_OPTION_NOT_SUPPORTED;
+  }
+
+  uint8_t pos = 0;
+  extWriteCmd[pos++] = 0x22; // no options, addressed by UID, high data rate
+  extWriteCmd[pos++] = 0x31;
+  for (int i=0; i<8; i++) {
+    extWriteCmd[pos++] = uid[i];
+  }
+  extWriteCmd[pos++] = (uint8_t)(blockNo & 0xff);
+  extWriteCmd[pos++] = (uint8_t)(blockNo >> 8);
+  for (int i=0; i<blockSize; i++) {
+    extWriteCmd[pos++] = blockData[i];
+  }
+
+  PN5180DEBUG(F("Extended Write Single Block #"));
+  PN5180DEBUG(blockNo);
+  PN5180DEBUG("\n");
+
+  uint8_t *resultPtr;
+  return issueISO15693Command(extWriteCmd, pos, &resultPtr);
+}
+
+/*
+ * Extended read multiple blocks, code=33
+ *
+ * Request format: SOF, Req.Flags, ExtReadMultipleBlocks, UID (opt.), FirstBlockNumber (2 bytes),
+ *                 NumBlocks-1 (2 bytes), CRC16, EOF
+ * Response format: same as READ MULTIPLE BLOCKS
+ */
+ISO15693ErrorCode PN5180ISO15693::extendedReadMultipleBlocks(uint8_t *uid, uint16_t blockNo, uint8_t numBlocks, uint8_t *blockData, uint8_t blockSize) {
+  if ((0 == numBlocks) || ((1 + numBlocks * blockSize) > 508)) {
+    PN5180DEBUG(F("ERROR: Number of blocks exceeds reception buffer!\n"));
+    return ISO15693_EC_OPTION_NOT_SUPPORTED;
+  }
+
+  //                                  flags, cmd, uid,             blockNo (2 bytes),                                   numBlocks-1 (2 bytes)
+  uint8_t extReadMultipleBlocks[] = { 0x22, 0x33, 1,2,3,4,5,6,7,8, (uint8_t)(blockNo & 0xff), (uint8_t)(blockNo >> 8), (uint8_t)(numBlocks-1), 0x00 };
+  for (int i=0; i<8; i++) {
+    extReadMultipleBlocks[2+i] = uid[i];
+  }
+
+  PN5180DEBUG(F("Extended Read Multiple Blocks #"));
+  PN5180DEBUG(blockNo);
+  PN5180DEBUG(F(", count="));
+  PN5180DEBUG(numBlocks);
+  PN5180DEBUG("\n");
+
+  uint8_t *resultPtr;
+  uint16_t len;
+  ISO15693ErrorCode rc = issueISO15693Command(extReadMultipleBlocks, sizeof(extReadMultipleBlocks), &resultPtr, &len);
+  if (ISO15693_EC_OK != rc) {
+    return rc;
+  }
+  // flags and block data
+  if (len < 1 + numBlocks*blockSize) {
+    return ISO15693_EC_UNKNOWN_ERROR;
+  }
+
+  for (int i=0; i<numBlocks*blockSize; i++) {
+    blockData[i] = resultPtr[1+i];
+  }
+
+  return ISO15693_EC_OK;
+}
+
 /*
  * Get System Information, code=2B
  *
@@ -266,16 +652,41 @@ ISO15693ErrorCode PN5180ISO15693::writeSingleBlock(uint8_t *uid, uint8_t blockNo
  *        nnnn.nnnn - Number of blocks is on 8 bits, allowing to specify up to 256 blocks.
  *
  *    IC reference: The IC reference is on 8 bits and its meaning is defined by the IC manufacturer.
+ *
+ * Extended Get System Information, code=3B
+ *
+ * Request format: SOF, Req.Flags, ExtGetSysInfo, InfoParamRequest, UID (opt.), CRC16, EOF
+ * Response format:
+ *  when ERROR flag is NOT set:
+ *    SOF, Flags, InfoFlags, UID, DSFID (opt.), AFI (opt.), Other fields (opt.), CRC16, EOF
+ *
+ *    InfoFlags: as above, plus
+ *    7654.xxxx
+ *      ||\_ MOI: 0=1 byte memory addressing, 1=2 bytes memory addressing
+ *      |\__ VICC command list: 1=command list field (4 bytes) is present
+ *      \___ CSI information: 1=CSI list is present
+ *
+ *    VICC memory size:
+ *      nnnn.nnnn nnnn.nnnn xxxb.bbbb
+ *        nnnn.nnnn nnnn.nnnn - Number of blocks is on 16 bits (LSB first), allowing to specify up to 65536 blocks.
+ *        bbbbb - Block size is expressed in number of bytes, on 5 bits.
  */
-ISO15693ErrorCode PN5180ISO15693::getSystemInfo(uint8_t *uid, uint8_t *blockSize, uint8_t *numBlocks) {
-  uint8_t sysInfo[] = { 0x22, 0x2b, 1,2,3,4,5,6,7,8 };  // UID has LSB first!
+ISO15693ErrorCode PN5180ISO15693::readSystemInfo(uint8_t *uid, ISO15693SystemInfo *info, bool extended) {
+  //                   flags, cmd, infoParam, uid
+  uint8_t sysInfo[] = { 0x22, 0x3b, 0x3f, 1,2,3,4,5,6,7,8 };  // UID has LSB first!
+  //                               \- DSFID, AFI, memory size, IC ref, MOI, command list
+  uint8_t uidPos = 3;
+  if (!extended) { // Get System Information without InfoParamRequest
+    sysInfo[1] = 0x2b;
+    uidPos = 2;
+  }
   for (int i=0; i<8; i++) {
-    sysInfo[2+i] = uid[i];
+    sysInfo[uidPos+i] = uid[i];
   }
 
 #ifdef DEBUG
-  PN5180DEBUG("Get System Information");
-  for (int i=0; i<sizeof(sysInfo); i++) {
+  PN5180DEBUG(extended ? "Get Extended System Information" : "Get System Information");
+  for (int i=0; i<uidPos+8; i++) {
     PN5180DEBUG(" ");
     PN5180DEBUG(formatHex(sysInfo[i]));
   }
@@ -283,13 +694,13 @@ ISO15693ErrorCode PN5180ISO15693::getSystemInfo(uint8_t *uid, uint8_t *blockSize
 #endif
 
   uint8_t *readBuffer;
-  ISO15693ErrorCode rc = issueISO15693Command(sysInfo, sizeof(sysInfo), &readBuffer);
+  ISO15693ErrorCode rc = issueISO15693Command(sysInfo, uidPos+8, &readBuffer);
   if (ISO15693_EC_OK != rc) {
     return rc;
   }
 
   for (int i=0; i<8; i++) {
-    uid[i] = readBuffer[2+i];
+    info->uid[i] = readBuffer[2+i];
   }
 
 #ifdef DEBUG
@@ -304,10 +715,19 @@ ISO15693ErrorCode PN5180ISO15693::getSystemInfo(uint8_t *uid, uint8_t *blockSize
   uint8_t *p = &readBuffer[10];
 
   uint8_t infoFlags = readBuffer[1];
+  info->infoFlags = infoFlags;
+  info->dsfid = 0;
+  info->afi = 0;
+  info->blockSize = 0;
+  info->numBlocks = 0;
+  info->icRef = 0;
+  info->commands = 0;
+  info->extendedAddressing = extended && (infoFlags & 0x10);
+
   if (infoFlags & 0x01) { // DSFID flag
-    uint8_t dsfid = *p++;
+    info->dsfid = *p++;
     PN5180DEBUG("DSFID=");  // Data storage format identifier
-    PN5180DEBUG(formatHex(dsfid));
+    PN5180DEBUG(formatHex(info->dsfid));
     PN5180DEBUG("\n");
   }
 #ifdef DEBUG
@@ -315,11 +735,11 @@ ISO15693ErrorCode PN5180ISO15693::getSystemInfo(uint8_t *uid, uint8_t *blockSize
 #endif
 
   if (infoFlags & 0x02) { // AFI flag
-    uint8_t afi = *p++;
+    info->afi = *p++;
     PN5180DEBUG(F("AFI="));  // Application family identifier
-    PN5180DEBUG(formatHex(afi));
+    PN5180DEBUG(formatHex(info->afi));
     PN5180DEBUG(F(" - "));
-    switch (afi >> 4) {
+    switch (info->afi >> 4) {
       case 0: PN5180DEBUG(F("All families")); break;
       case 1: PN5180DEBUG(F("Transport")); break;
       case 2: PN5180DEBUG(F("Financial")); break;
@@ -342,20 +762,22 @@ ISO15693ErrorCode PN5180ISO15693::getSystemInfo(uint8_t *uid, uint8_t *blockSize
 #endif
 
   if (infoFlags & 0x04) { // VICC Memory size
-    *numBlocks = *p++;
-    *blockSize = *p++;
-    *blockSize = (*blockSize) & 0x1f;
+    if (extended) {
+      info->numBlocks = *p++;
+      info->numBlocks |= ((uint32_t)(*p++)) << 8;
+    }
+    else info->numBlocks = *p++;
+    info->blockSize = (*p++) & 0x1f;
 
-    *blockSize = *blockSize + 1; // range: 1-32
-    *numBlocks = *numBlocks + 1; // range: 1-256
-    uint16_t viccMemSize = (*blockSize) * (*numBlocks);
+    info->blockSize = info->blockSize + 1; // range: 1-32
+    info->numBlocks = info->numBlocks + 1; // range: 1-256, extended: 1-65536
 
     PN5180DEBUG("VICC MemSize=");
-    PN5180DEBUG(viccMemSize);
+    PN5180DEBUG(info->blockSize * info->numBlocks);
     PN5180DEBUG(" BlockSize=");
-    PN5180DEBUG(*blockSize);
+    PN5180DEBUG(info->blockSize);
     PN5180DEBUG(" NumBlocks=");
-    PN5180DEBUG(*numBlocks);
+    PN5180DEBUG(info->numBlocks);
     PN5180DEBUG("\n");
   }
 #ifdef DEBUG
@@ -363,18 +785,101 @@ ISO15693ErrorCode PN5180ISO15693::getSystemInfo(uint8_t *uid, uint8_t *blockSize
 #endif
 
   if (infoFlags & 0x08) { // IC reference
-    uint8_t icRef = *p++;
+    info->icRef = *p++;
     PN5180DEBUG("IC Ref=");
-    PN5180DEBUG(formatHex(icRef));
+    PN5180DEBUG(formatHex(info->icRef));
     PN5180DEBUG("\n");
   }
 #ifdef DEBUG
   else PN5180DEBUG(F("No IC ref\n"));
 #endif
 
+  if (extended && (infoFlags & 0x20)) { // VICC command list
+    for (int i=0; i<4; i++) {
+      info->commands |= ((uint32_t)(*p++)) << (8*i);
+    }
+    PN5180DEBUG("Command list=");
+    PN5180DEBUG(formatHex(info->commands));
+    PN5180DEBUG("\n");
+  }
+
+  return ISO15693_EC_OK;
+}
+
+/*
+ * Get System Information with cache
+ *
+ * The system information of the last ISO15693_SYSINFO_CACHE_SIZE labels is cached by
+ * UID, so repeated reads of the same label do not issue the command again.
+ * Labels with more than 256 blocks only report their complete memory size with the
+ * Extended Get System Information, which is tried, if the standard command is not
+ * supported or reports the maximum of 256 blocks.
+ */
+ISO15693ErrorCode PN5180ISO15693::getSystemInfo(uint8_t *uid, ISO15693SystemInfo *info) {
+  for (uint8_t n=0; n<ISO15693_SYSINFO_CACHE_SIZE; n++) {
+    if (sysInfoCacheValid[n] && (0 == memcmp(sysInfoCache[n].uid, uid, 8))) {
+      PN5180DEBUG(F("System Information from cache\n"));
+      *info = sysInfoCache[n];
+      return ISO15693_EC_OK;
+    }
+  }
+
+  ISO15693ErrorCode rc = readSystemInfo(uid, info, false);
+  bool tryExtended = (ISO15693_EC_NOT_SUPPORTED == rc) || (ISO15693_EC_NOT_RECOGNIZED == rc) ||
+                     ((ISO15693_EC_OK == rc) && (256 == info->numBlocks));
+  if (tryExtended) {
+    ISO15693SystemInfo extInfo;
+    if (ISO15693_EC_OK == readSystemInfo(uid, &extInfo, true)) {
+      *info = extInfo;
+      rc = ISO15693_EC_OK;
+    }
+  }
+  if (ISO15693_EC_OK != rc) {
+    return rc;
+  }
+
+  sysInfoCache[sysInfoCacheNext] = *info;
+  sysInfoCacheValid[sysInfoCacheNext] = true;
+  sysInfoCacheNext = (sysInfoCacheNext + 1) % ISO15693_SYSINFO_CACHE_SIZE;
+
   return ISO15693_EC_OK;
 }
 
+/*
+ * Extended Get System Information, not cached
+ */
+ISO15693ErrorCode PN5180ISO15693::getExtendedSystemInfo(uint8_t *uid, ISO15693SystemInfo *info) {
+  return readSystemInfo(uid, info, true);
+}
+
+/*
+ * Get System Information, blockSize and numBlocks only
+ * numBlocks is 0, if the label has 256 blocks or more.
+ */
+ISO15693ErrorCode PN5180ISO15693::getSystemInfo(uint8_t *uid, uint8_t *blockSize, uint8_t *numBlocks) {
+  ISO15693SystemInfo info;
+  ISO15693ErrorCode rc = getSystemInfo(uid, &info);
+  if (ISO15693_EC_OK != rc) {
+    return rc;
+  }
+
+  for (int i=0; i<8; i++) {
+    uid[i] = info.uid[i];
+  }
+  if (info.infoFlags & 0x04) {
+    *blockSize = info.blockSize;
+    *numBlocks = (info.numBlocks > 255) ? 0 : (uint8_t)info.numBlocks;
+  }
+
+  return ISO15693_EC_OK;
+}
+
+void PN5180ISO15693::clearSystemInfoCache() {
+  for (uint8_t n=0; n<ISO15693_SYSINFO_CACHE_SIZE; n++) {
+    sysInfoCacheValid[n] = false;
+  }
+  sysInfoCacheNext = 0;
+}
 
 // ICODE SLIX specific commands
 
@@ -485,6 +990,227 @@ ISO15693ErrorCode PN5180ISO15693::newpasswordICODESLIX2(uint8_t *newpassword, ui
 }
 
 
+/*
+ * INVENTORY READ, code=A0 (custom command, IC manufacturer code 0x04)
+ *
+ * Request format: SOF, Req.Flags, InventoryRead, IC Mfg code, AFI (opt.), Mask len, Mask value,
+ *                 FirstBlockNumber, NumBlocks-1, CRC16, EOF
+ * Response format (per slot, option flag set):
+ *                 SOF, Resp.Flags, UID (without mask), BlockData (len=numBlocks*blockSize), CRC16, EOF
+ *
+ * Combines the inventory with a READ MULTIPLE BLOCKS, so that each label found in the
+ * 16 slots of one round returns its UID together with the requested blocks.
+ *
+ * uids : must be an array of maxTags*8 bytes, each UID with LSB first
+ * blockData : must be an array of maxTags*numBlocks*blockSize bytes
+ */
+ISO15693ErrorCode PN5180ISO15693::inventoryRead(uint8_t blockNo, uint8_t numBlocks, uint8_t blockSize,
+                                                uint8_t *uids, uint8_t *blockData, uint8_t maxTags, uint8_t *numTags) {
+  if ((0 == numBlocks) || ((1 + 8 + numBlocks * blockSize) > 508)) {
+    PN5180DEBUG(F("ERROR: Number of blocks exceeds reception buffer!\n"));
+    return ISO15693_EC_OPTION_NOT_SUPPORTED;
+  }
+
+  //                         Flags,  CMD, mfg,              maskLen, blockNo, numBlocks-1
+  uint8_t inventoryRead[] = { 0x46, 0xA0, ISO15693_MFG_NXP, 0x00,    blockNo, (uint8_t)(numBlocks-1) };
+  //                            ||\- inventory flag + high data rate
+  //                            |\-- 16 slots, no AFI field present
+  //                            \--- option flag: UID is returned with block data
+  PN5180DEBUG(F("Inventory Read...\n"));
+
+  uint16_t collisions;
+  return inventoryRound(inventoryRead, sizeof(inventoryRead), 0, NULL, numBlocks * blockSize,
+                        uids, blockData, maxTags, numTags, &collisions);
+}
+
+
+// ICODE fast commands
+
+/*
+ * FAST READ MULTIPLE BLOCKS, code=C3 (custom command, IC manufacturer code 0x04)
+ *
+ * Request format: SOF, Req.Flags, FastReadMultipleBlocks, IC Mfg code, UID (opt.), FirstBlockNumber, NumBlocks-1, CRC16, EOF
+ * Response format: same as READ MULTIPLE BLOCKS, but sent by the label with 53 kbit/s
+ *
+ * Only NXP ICODE labels support this command. For other labels, the standard
+ * READ MULTIPLE BLOCKS command is issued instead.
+ */
+ISO15693ErrorCode PN5180ISO15693::fastReadMultipleBlocks(uint8_t *uid, uint8_t blockNo, uint8_t numBlocks, uint8_t *blockData, uint8_t blockSize) {
+  if (!isICODE(uid)) {
+    return readMultipleBlocks(uid, blockNo, numBlocks, blockData, blockSize);
+  }
+  if ((0 == numBlocks) || ((1 + numBlocks * blockSize) > 508)) {
+    PN5180DEBUG(F("ERROR: Number of blocks exceeds reception buffer!\n"));
+    return ISO15693_EC_OPTION_NOT_SUPPORTED;
+  }
+
+  //                          flags, cmd, mfg,              uid,             blockNo, numBlocks-1
+  uint8_t fastReadMultiple[] = { 0x22, 0xC3, ISO15693_MFG_NXP, 1,2,3,4,5,6,7,8, blockNo, (uint8_t)(numBlocks-1) }; // UID has LSB first!
+  //                               |\- high data rate, required for fast response
+  //                               \-- no options, addressed by UID
+  for (int i=0; i<8; i++) {
+    fastReadMultiple[3+i] = uid[i];
+  }
+
+  PN5180DEBUG(F("Fast Read Multiple Blocks #"));
+  PN5180DEBUG(blockNo);
+  PN5180DEBUG(F(", count="));
+  PN5180DEBUG(numBlocks);
+  PN5180DEBUG("\n");
+
+  uint8_t *resultPtr;
+  uint16_t len;
+  ISO15693ErrorCode rc = issueISO15693Command(fastReadMultiple, sizeof(fastReadMultiple), &resultPtr, &len);
+  if (ISO15693_EC_OK != rc) {
+    return rc;
+  }
+  // flags and block data
+  if (len < 1 + numBlocks*blockSize) {
+    return ISO15693_EC_UNKNOWN_ERROR;
+  }
+
+  for (int i=0; i<numBlocks*blockSize; i++) {
+    blockData[i] = resultPtr[1+i];
+  }
+
+  return ISO15693_EC_OK;
+}
+
+
+/*
+ * FAST INVENTORY READ, code=A1 (custom command, IC manufacturer code 0x04)
+ *
+ * Same as INVENTORY READ, but the labels respond with 53 kbit/s.
+ */
+ISO15693ErrorCode PN5180ISO15693::fastInventoryRead(uint8_t blockNo, uint8_t numBlocks, uint8_t blockSize,
+                                                    uint8_t *uids, uint8_t *blockData, uint8_t maxTags, uint8_t *numTags) {
+  if ((0 == numBlocks) || ((1 + 8 + numBlocks * blockSize) > 508)) {
+    PN5180DEBUG(F("ERROR: Number of blocks exceeds reception buffer!\n"));
+    return ISO15693_EC_OPTION_NOT_SUPPORTED;
+  }
+
+  //                             Flags,  CMD, mfg,              maskLen, blockNo, numBlocks-1
+  uint8_t fastInventoryRead[] = { 0x46, 0xA1, ISO15693_MFG_NXP, 0x00,    blockNo, (uint8_t)(numBlocks-1) };
+  //                                ||\- inventory flag + high data rate
+  //                                |\-- 16 slots, no AFI field present
+  //                                \--- option flag: UID is returned with block data
+  PN5180DEBUG(F("Fast Inventory Read...\n"));
+
+  uint16_t collisions;
+  return inventoryRound(fastInventoryRead, sizeof(fastInventoryRead), 0, NULL, numBlocks * blockSize,
+                        uids, blockData, maxTags, numTags, &collisions);
+}
+
+/*
+ * Inventory round with 16 slots
+ *
+ * The request in cmd must have the inventory flag set and the number of slots flag cleared.
+ * After the request, the label responses of slot 0 are received. Each following slot is
+ * started by sending an EOF only, i.e. with TX_DATA_ENABLE cleared in TX_CONFIG.
+ *
+ * For the standard inventory (code 01), the response contains the complete UID after the
+ * DSFID. For the ICODE inventory read commands with option flag set, the response contains
+ * the UID without the mask bytes, followed by dataLen bytes of block data.
+ *
+ * collisions : bit n is set, if the responses in slot n collided
+ *
+ * Function return values:
+ *    0 = OK, at least one label was found or a collision occurred
+ *   -1 = No card detected in any slot
+ */
+ISO15693ErrorCode PN5180ISO15693::inventoryRound(uint8_t *cmd, uint8_t cmdLen, uint8_t maskLen, uint8_t *mask, uint16_t dataLen,
+                                                 uint8_t *uids, uint8_t *data, uint8_t maxTags, uint8_t *numTags, uint16_t *collisions) {
+  *numTags = 0;
+  *collisions = 0;
+
+  if (!setRxFastMode(isFastCommand(cmd[1]))) {
+    return ISO15693_EC_UNKNOWN_ERROR;
+  }
+
+  uint32_t txConfig;
+  readRegister(TX_CONFIG, &txConfig);
+
+  clearIRQStatus(0xffffffff);
+  if (!sendData(cmd, cmdLen)) {
+    return ISO15693_EC_UNKNOWN_ERROR;
+  }
+
+  bool inventoryCmd = (0x01 == cmd[1]);
+  uint8_t maskBytes = maskLen / 8;
+  // flags, DSFID and UID for INVENTORY, flags and UID without mask for INVENTORY READ,
+  // followed by the data, shorter responses are skipped
+  uint16_t respLen = (inventoryCmd ? 10 : (1 + 8 - maskBytes)) + dataLen;
+
+  for (uint8_t slot=0; slot<16; slot++) {
+    // wait for end of transmission, then give the label time to respond
+    uint32_t irqStatus = getIRQStatus();
+    while (0 == (irqStatus & TX_IRQ_STAT)) {
+      irqStatus = getIRQStatus();
+    }
+    delay(1);
+    irqStatus = getIRQStatus();
+
+    if (irqStatus & RX_SOF_DET_IRQ_STAT) {
+      while (0 == (irqStatus & RX_IRQ_STAT)) {
+        delay(1);
+        irqStatus = getIRQStatus();
+      }
+
+      uint32_t rxStatus;
+      readRegister(RX_STATUS, &rxStatus);
+      uint16_t len = (uint16_t)(rxStatus & 0x000001ff);
+
+      if (rxStatus & (RX_COLLISION_DETECTED | RX_DATA_INTEGRITY_ERROR)) {
+        PN5180DEBUG(F("Collision in slot "));
+        PN5180DEBUG(slot);
+        PN5180DEBUG("\n");
+        *collisions |= (1 << slot);
+      }
+      else if (len >= respLen) {
+        uint8_t *resp = readData(len);
+        if ((0L != resp) && (0 == (resp[0] & 0x01)) && (*numTags < maxTags)) { // no error flag
+          uint8_t *uid = &uids[8 * (*numTags)];
+          uint8_t *p;
+          if (inventoryCmd) {
+            p = &resp[2]; // skip flags and DSFID
+            for (int i=0; i<8; i++) uid[i] = *p++;
+          }
+          else {
+            p = &resp[1]; // skip flags, UID without mask follows
+            for (int i=0; i<maskBytes; i++) uid[i] = mask[i];
+            for (int i=maskBytes; i<8; i++) uid[i] = *p++;
+          }
+          if ((0 < dataLen) && (0L != data)) {
+            uint8_t *d = &data[dataLen * (*numTags)];
+            for (int i=0; i<dataLen; i++) d[i] = *p++;
+          }
+          (*numTags)++;
+        }
+      }
+    }
+
+    if (slot < 15) { // send EOF to switch to next slot
+      writeRegisterWithAndMask(TX_CONFIG, 0xfffffb3f);
+      clearIRQStatus(0xffffffff);
+      sendData(cmd, 0);
+    }
+  }
+
+  writeRegister(TX_CONFIG, txConfig);
+  clearIRQStatus(0xffffffff);
+
+  PN5180DEBUG(F("Inventory round: tags="));
+  PN5180DEBUG(*numTags);
+  PN5180DEBUG(F(", collisions=0x"));
+  PN5180DEBUG(formatHex(*collisions));
+  PN5180DEBUG("\n");
+
+  if ((0 == *numTags) && (0 == *collisions)) {
+    return EC_NO_CARD;
+  }
+  return ISO15693_EC_OK;
+}
+
 /*
  * ISO 15693 - Protocol
  *
@@ -539,13 +1265,18 @@ ISO15693ErrorCode PN5180ISO15693::newpasswordICODESLIX2(uint8_t *newpassword, ui
  *   -1 = No card detected
  *   >0 = Error code
  */
-ISO15693ErrorCode PN5180ISO15693::issueISO15693Command(uint8_t *cmd, uint8_t cmdLen, uint8_t **resultPtr) {
+ISO15693ErrorCode PN5180ISO15693::issueISO15693Command(uint8_t *cmd, uint8_t cmdLen, uint8_t **resultPtr, uint16_t *resultLen) {
 #ifdef DEBUG
   PN5180DEBUG(F("Issue Command 0x"));
   PN5180DEBUG(formatHex(cmd[1]));
   PN5180DEBUG("...\n");
 #endif
 
+  // ICODE fast commands are answered with 53 kbit/s, all others with 26 kbit/s
+  if (!setRxFastMode(isFastCommand(cmd[1]))) {
+    return ISO15693_EC_UNKNOWN_ERROR;
+  }
+
   sendData(cmd, cmdLen);
   delay(10);
   uint32_t status = getIRQStatus();
@@ -564,6 +1295,7 @@ ISO15693ErrorCode PN5180ISO15693::issueISO15693Command(uint8_t *cmd, uint8_t cmd
   PN5180DEBUG(formatHex(rxStatus));
 
   uint16_t len = (uint16_t)(rxStatus & 0x000001ff);
+  if (resultLen) *resultLen = len;
 
   PN5180DEBUG(", len=");
   PN5180DEBUG(len);
@@ -629,12 +1361,44 @@ bool PN5180ISO15693::setupRF() {
   }
   else return false;
 
-  writeRegisterWithAndMask(SYSTEM_CONFIG, 0xfffffff8);  // Idle/StopCom Command
-  writeRegisterWithOrMask(SYSTEM_CONFIG, 0x00000003);   // Transceive Command
+  writeRegisterWithAndMask(SYSTEM_CONFIG, ~SYSTEM_CONFIG_COMMAND_MASK);  // Idle/StopCom Command
+  writeRegisterWithOrMask(SYSTEM_CONFIG, SYSTEM_CONFIG_TRANSCEIVE);     // Transceive Command
 
   return true;
 }
 
+/*
+ * Switch to ISO15693 with the RF field already on, e.g. after another protocol was used
+ */
+bool PN5180ISO15693::loadProtocolConfig() {
+  return applyProfile(PN5180_PROFILE_ISO15693);
+}
+
+/*
+ * Switch the receiver between 26 kbit/s (RF config 0x8D) and 53 kbit/s (RF config 0x8E).
+ * The transmitter configuration is left unchanged (0xFF), since requests are always
+ * sent with 26 kbit/s. The RF config cache of the chip reloads it only, if the data
+ * rate changes.
+ */
+bool PN5180ISO15693::setRxFastMode(bool fast) {
+  return loadRFConfig(0xff, fast ? 0x8e : 0x8d);
+}
+
+/*
+ * ICODE fast commands: FAST INVENTORY READ, FAST INVENTORY PAGE READ, FAST READ MULTIPLE BLOCKS
+ */
+bool PN5180ISO15693::isFastCommand(uint8_t cmd) {
+  return (0xA1 == cmd) || (0xB1 == cmd) || (0xC3 == cmd);
+}
+
+/*
+ * Check for an NXP ICODE label, which supports the ICODE custom and fast commands.
+ * UID has LSB first: uid[7] is always 0xE0, uid[6] is the IC manufacturer code.
+ */
+bool PN5180ISO15693::isICODE(uint8_t *uid) {
+  return (0xE0 == uid[7]) && (ISO15693_MFG_NXP == uid[6]);
+}
+
 const __FlashStringHelper *PN5180ISO15693::strerror(ISO15693ErrorCode errno) {
   PN5180DEBUG(F("ISO15693ErrorCode="));
   PN5180DEBUG(errno);
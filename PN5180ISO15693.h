@@ -36,20 +36,73 @@ enum ISO15693ErrorCode {
   ISO15693_EC_CUSTOM_CMD_ERROR = 0xA0
 };
 
+// NXP Semiconductors IC manufacturer code, see ISO/IEC 7816-6
+#define ISO15693_MFG_NXP    (0x04)
+
+// Number of labels, whose system information is cached
+#ifndef ISO15693_SYSINFO_CACHE_SIZE
+#define ISO15693_SYSINFO_CACHE_SIZE  (4)
+#endif
+
+struct ISO15693SystemInfo {
+  uint8_t uid[8];           // LSB first
+  uint8_t infoFlags;        // which of the following fields are supported by the label
+  uint8_t dsfid;            // data storage format identifier
+  uint8_t afi;              // application family identifier
+  uint8_t blockSize;        // 1-32 bytes
+  uint32_t numBlocks;       // 1-256, extended: 1-65536
+  uint8_t icRef;            // IC reference
+  uint32_t commands;        // extended only: VICC command list, LSB first
+  bool extendedAddressing;  // extended only: 2 bytes block numbers required
+};
+
+// Max. number of pending mask partitions in getInventoryPartitioned
+#ifndef ISO15693_MAX_PARTITIONS
+#define ISO15693_MAX_PARTITIONS  (16)
+#endif
+
 class PN5180ISO15693 : public PN5180 {
 
 public:
   PN5180ISO15693(uint8_t SSpin, uint8_t BUSYpin, uint8_t RSTpin);
   
 private:
-  ISO15693ErrorCode issueISO15693Command(uint8_t *cmd, uint8_t cmdLen, uint8_t **resultPtr);
+
+  ISO15693SystemInfo sysInfoCache[ISO15693_SYSINFO_CACHE_SIZE];
+  bool sysInfoCacheValid[ISO15693_SYSINFO_CACHE_SIZE];
+  uint8_t sysInfoCacheNext;
+
+  ISO15693ErrorCode issueISO15693Command(uint8_t *cmd, uint8_t cmdLen, uint8_t **resultPtr, uint16_t *resultLen = NULL);
+  ISO15693ErrorCode inventoryRound(uint8_t *cmd, uint8_t cmdLen, uint8_t maskLen, uint8_t *mask, uint16_t dataLen,
+                                   uint8_t *uids, uint8_t *data, uint8_t maxTags, uint8_t *numTags, uint16_t *collisions);
+  bool setRxFastMode(bool fast);
+  static bool isFastCommand(uint8_t cmd);
+  static uint8_t buildInventoryRequest(uint8_t *cmd, uint8_t flags, uint8_t afi, uint8_t maskLen, uint8_t *mask);
+  ISO15693ErrorCode readSystemInfo(uint8_t *uid, ISO15693SystemInfo *info, bool extended);
 public:
   ISO15693ErrorCode getInventory(uint8_t *uid);
+  ISO15693ErrorCode getInventory(uint8_t *uid, uint8_t afi, uint8_t maskLen, uint8_t *mask);
+  ISO15693ErrorCode getInventoryMultiple(uint8_t *uids, uint8_t maxTags, uint8_t *numTags);
+  ISO15693ErrorCode getInventoryMultiple(uint8_t *uids, uint8_t maxTags, uint8_t *numTags,
+                                         uint8_t afi, uint8_t maskLen, uint8_t *mask, uint16_t *collisions);
+  ISO15693ErrorCode getInventoryPartitioned(uint8_t *uids, uint8_t maxTags, uint8_t *numTags,
+                                            uint8_t afi = 0x00, uint8_t *numRounds = NULL);
+  ISO15693ErrorCode stayQuiet(uint8_t *uid);
+  ISO15693ErrorCode resetToReady(uint8_t *uid);
 
   ISO15693ErrorCode readSingleBlock(uint8_t *uid, uint8_t blockNo, uint8_t *blockData, uint8_t blockSize);
   ISO15693ErrorCode writeSingleBlock(uint8_t *uid, uint8_t blockNo, uint8_t *blockData, uint8_t blockSize);
+  ISO15693ErrorCode readMultipleBlocks(uint8_t *uid, uint8_t blockNo, uint8_t numBlocks, uint8_t *blockData, uint8_t blockSize);
+
+  // 2 bytes block addressing for labels with more than 256 blocks
+  ISO15693ErrorCode extendedReadSingleBlock(uint8_t *uid, uint16_t blockNo, uint8_t *blockData, uint8_t blockSize);
+  ISO15693ErrorCode extendedWriteSingleBlock(uint8_t *uid, uint16_t blockNo, uint8_t *blockData, uint8_t blockSize);
+  ISO15693ErrorCode extendedReadMultipleBlocks(uint8_t *uid, uint16_t blockNo, uint8_t numBlocks, uint8_t *blockData, uint8_t blockSize);
 
   ISO15693ErrorCode getSystemInfo(uint8_t *uid, uint8_t *blockSize, uint8_t *numBlocks);
+  ISO15693ErrorCode getSystemInfo(uint8_t *uid, ISO15693SystemInfo *info);
+  ISO15693ErrorCode getExtendedSystemInfo(uint8_t *uid, ISO15693SystemInfo *info);
+  void clearSystemInfoCache();
    
   // ICODE SLIX2 specific commands, see https://www.nxp.com/docs/en/data-sheet/SL2S2602.pdf
   ISO15693ErrorCode getRandomNumber(uint8_t *randomData);
@@ -59,11 +112,22 @@ public:
   ISO15693ErrorCode unlockICODESLIX2(uint8_t *password);
   ISO15693ErrorCode lockICODESLIX2(uint8_t *password);
   ISO15693ErrorCode newpasswordICODESLIX2(uint8_t *newpassword, uint8_t *oldpassword, uint8_t *uid);
+
+  // ICODE inventory with block data, 16 slots per round
+  ISO15693ErrorCode inventoryRead(uint8_t blockNo, uint8_t numBlocks, uint8_t blockSize,
+                                  uint8_t *uids, uint8_t *blockData, uint8_t maxTags, uint8_t *numTags);
+
+  // ICODE fast commands, response is sent with 53 kbit/s
+  ISO15693ErrorCode fastReadMultipleBlocks(uint8_t *uid, uint8_t blockNo, uint8_t numBlocks, uint8_t *blockData, uint8_t blockSize);
+  ISO15693ErrorCode fastInventoryRead(uint8_t blockNo, uint8_t numBlocks, uint8_t blockSize,
+                                      uint8_t *uids, uint8_t *blockData, uint8_t maxTags, uint8_t *numTags);
   /*
    * Helper functions
    */
 public:   
   bool setupRF();
+  bool loadProtocolConfig();
+  bool isICODE(uint8_t *uid);
   const __FlashStringHelper *strerror(ISO15693ErrorCode errno);
     
 };
@@ -0,0 +1,148 @@
+// NAME: PN5180ISO15693Portal.cpp
+//
+// DESC: Continuous ISO15693 inventory for portal and conveyor applications.
+//
+// Copyright (c) 2018 by Andreas Trappmann. All rights reserved.
+//
+// This file is part of the PN5180 library for the Arduino environment.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+//#define DEBUG 1
+
+#include <Arduino.h>
+#include "PN5180ISO15693Portal.h"
+#include "Debug.h"
+
+/*
+ * In a portal, the same labels stay in the field for many inventory rounds. Each label,
+ * which has been identified, is sent into quiet state, so that it does not compete with
+ * newly arriving labels anymore. Every readmitInterval milliseconds, the quiet labels
+ * are returned to ready state, either by an addressed RESET TO READY, or by switching
+ * the RF field off and on. A label, which does not answer the RESET TO READY, or which is
+ * not found again until the next readmit after a field reset, has left the field.
+ */
+PN5180ISO15693Portal::PN5180ISO15693Portal(PN5180ISO15693 &nfc, uint16_t readmitInterval, ISO15693PortalReadmit readmitMode)
+                    : nfc(nfc) {
+  this->handler = NULL;
+  this->readmitInterval = readmitInterval;
+  this->readmitMode = readmitMode;
+  reset();
+}
+
+void PN5180ISO15693Portal::setEventHandler(ISO15693PortalEventHandler handler) {
+  this->handler = handler;
+}
+
+/*
+ * Forget all tracked labels and statistics, no events are emitted.
+ */
+void PN5180ISO15693Portal::reset() {
+  numTags = 0;
+  numReads = 0;
+  inventoryTime = 0;
+  lastReadmit = millis();
+}
+
+/*
+ * One cycle of the continuous inventory: readmit quiet labels, if the interval has
+ * elapsed, then run one 16 slot inventory round and send all found labels to quiet.
+ *
+ * return value: the number of newly arrived labels
+ */
+uint8_t PN5180ISO15693Portal::poll() {
+  uint32_t now = millis();
+  if ((uint32_t)(now - lastReadmit) >= readmitInterval) {
+    readmit(now);
+    lastReadmit = now;
+  }
+
+  uint8_t uids[8*ISO15693_PORTAL_MAX_TAGS];
+  uint8_t found = 0;
+  uint32_t start = millis();
+  ISO15693ErrorCode rc = nfc.getInventoryMultiple(uids, ISO15693_PORTAL_MAX_TAGS, &found);
+  now = millis();
+  inventoryTime += (now - start);
+  if (ISO15693_EC_OK != rc) {
+    return 0;
+  }
+
+  uint8_t arrived = 0;
+  for (uint8_t n=0; n<found; n++) {
+    uint8_t *uid = &uids[8*n];
+    numReads++;
+
+    int8_t index = find(uid);
+    if (index < 0) {
+      if (numTags >= ISO15693_PORTAL_MAX_TAGS) {
+        PN5180DEBUG(F("Portal: too many labels, not tracked\n"));
+        continue; // label is not sent to quiet, so it will be found again
+      }
+      index = numTags++;
+      for (int i=0; i<8; i++) tags[index].uid[i] = uid[i];
+      tags[index].firstSeen = now;
+      arrived++;
+      if (handler) handler(ISO15693_TAG_ARRIVED, tags[index].uid, now);
+    }
+    tags[index].lastSeen = now;
+    tags[index].confirmed = true;
+
+    nfc.stayQuiet(uid);
+  }
+
+  return arrived;
+}
+
+/*
+ * Identified labels per second of inventory time
+ */
+uint16_t PN5180ISO15693Portal::getTagsPerSecond() {
+  if (0 == inventoryTime) return 0;
+  return (uint16_t)((numReads * 1000UL) / inventoryTime);
+}
+
+void PN5180ISO15693Portal::readmit(uint32_t now) {
+  if (ISO15693_READMIT_FIELD_RESET == readmitMode) {
+    // labels not found again since the last field reset have left the field
+    for (int8_t i=numTags-1; i>=0; i--) {
+      if (!tags[i].confirmed) depart(i);
+      else tags[i].confirmed = false;
+    }
+    PN5180DEBUG(F("Portal: field reset\n"));
+    nfc.setRF_off();
+    nfc.setRF_on();
+    delay(1); // labels are ready 1ms after field on
+    return;
+  }
+
+  for (int8_t i=numTags-1; i>=0; i--) {
+    if (ISO15693_EC_OK == nfc.resetToReady(tags[i].uid)) {
+      tags[i].lastSeen = now;
+    }
+    else depart(i);
+  }
+}
+
+void PN5180ISO15693Portal::depart(uint8_t index) {
+  if (handler) handler(ISO15693_TAG_DEPARTED, tags[index].uid, tags[index].lastSeen);
+
+  numTags--;
+  if (index < numTags) {
+    tags[index] = tags[numTags];
+  }
+}
+
+int8_t PN5180ISO15693Portal::find(const uint8_t *uid) {
+  for (uint8_t n=0; n<numTags; n++) {
+    if (0 == memcmp(tags[n].uid, uid, 8)) return n;
+  }
+  return -1;
+}
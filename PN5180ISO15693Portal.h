@@ -0,0 +1,83 @@
+// NAME: PN5180ISO15693Portal.h
+//
+// DESC: Continuous ISO15693 inventory for portal and conveyor applications.
+//
+// Copyright (c) 2018 by Andreas Trappmann. All rights reserved.
+//
+// This file is part of the PN5180 library for the Arduino environment.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+#ifndef PN5180ISO15693PORTAL_H
+#define PN5180ISO15693PORTAL_H
+
+#include "PN5180ISO15693.h"
+
+// Max. number of labels tracked in the field at the same time
+#ifndef ISO15693_PORTAL_MAX_TAGS
+#define ISO15693_PORTAL_MAX_TAGS  (16)
+#endif
+
+enum ISO15693PortalEvent {
+  ISO15693_TAG_ARRIVED = 0,
+  ISO15693_TAG_DEPARTED = 1
+};
+
+enum ISO15693PortalReadmit {
+  ISO15693_READMIT_RESET_TO_READY = 0,  // addressed RESET TO READY for each tracked label
+  ISO15693_READMIT_FIELD_RESET = 1      // switch RF field off and on
+};
+
+// timestamp: millis() of first detection for ARRIVED, of last detection for DEPARTED
+typedef void (*ISO15693PortalEventHandler)(ISO15693PortalEvent event, const uint8_t *uid, uint32_t timestamp);
+
+class PN5180ISO15693Portal {
+
+private:
+  struct Tag {
+    uint8_t uid[8];     // LSB first
+    uint32_t firstSeen;
+    uint32_t lastSeen;
+    bool confirmed;     // seen since last readmit
+  };
+
+  PN5180ISO15693 &nfc;
+  ISO15693PortalEventHandler handler;
+  ISO15693PortalReadmit readmitMode;
+  uint16_t readmitInterval;
+  uint32_t lastReadmit;
+
+  Tag tags[ISO15693_PORTAL_MAX_TAGS];
+  uint8_t numTags;
+
+  uint32_t numReads;
+  uint32_t inventoryTime;
+
+public:
+  PN5180ISO15693Portal(PN5180ISO15693 &nfc, uint16_t readmitInterval = 500,
+                       ISO15693PortalReadmit readmitMode = ISO15693_READMIT_RESET_TO_READY);
+
+  void setEventHandler(ISO15693PortalEventHandler handler);
+  void reset();
+
+  uint8_t poll();
+
+  uint8_t getNumTags() { return numTags; }
+  const uint8_t *getUID(uint8_t index) { return tags[index].uid; }
+  uint16_t getTagsPerSecond();
+
+private:
+  void readmit(uint32_t now);
+  void depart(uint8_t index);
+  int8_t find(const uint8_t *uid);
+};
+
+#endif /* PN5180ISO15693PORTAL_H */
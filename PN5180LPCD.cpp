@@ -0,0 +1,157 @@
+// NAME: PN5180LPCD.cpp
+//
+// DESC: Low-Power Card Detection standby for the PN5180Reader.
+//
+// Copyright (c) 2018 by Andreas Trappmann. All rights reserved.
+//
+// This file is part of the PN5180 library for the Arduino environment.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+//#define DEBUG 1
+
+#include <Arduino.h>
+#include "PN5180LPCD.h"
+#include "Debug.h"
+
+/*
+ * In LPCD, the PN5180 stays in standby and senses the field for a short time after
+ * each wakeup counter period. A card in the field detunes the antenna and wakes up
+ * the PN5180, which sets the IRQ pin. Then the reader polls all protocols as usual,
+ * until no card was found for PN5180_LPCD_IDLE_POLLS cycles, and LPCD is entered
+ * again. The reference is calibrated at each entry, so it is taken without a card.
+ *
+ * irqPin: PN5180 IRQ, active high (IRQ_PIN_CONFIG default)
+ */
+PN5180LPCD::PN5180LPCD(PN5180Reader &reader, uint8_t irqPin) : reader(reader) {
+  this->irqPin = irqPin;
+  wakeupCounter = 100;
+  fieldOnTime = 0;
+  inStandby = false;
+  awaitingCard = false;
+  idlePolls = 0;
+  clearStats();
+}
+
+/*
+ * Call after reader.begin()
+ * wakeupCounter: milliseconds between two card detections
+ * fieldOnTime: duration of the field for each detection, 62us + fieldOnTime * 8us
+ * threshold: min. change of the AGC value for a wakeup
+ */
+bool PN5180LPCD::begin(uint16_t wakeupCounter, uint8_t fieldOnTime, uint8_t threshold) {
+  pinMode(irqPin, INPUT);
+  this->wakeupCounter = wakeupCounter;
+  this->fieldOnTime = fieldOnTime;
+  inStandby = false;
+  awaitingCard = false;
+  idlePolls = 0;
+  stateStart = millis();
+  return reader.getChip().prepareLPCD(fieldOnTime, threshold);
+}
+
+void PN5180LPCD::updateTime() {
+  uint32_t now = millis();
+  if (inStandby) standbyTime += now - stateStart;
+  else activeTime += now - stateStart;
+  stateStart = now;
+}
+
+bool PN5180LPCD::standby() {
+  if (inStandby) {
+    return true;
+  }
+  if (!reader.fieldOff()) {
+    return false;
+  }
+  if (!reader.getChip().switchToLPCD(wakeupCounter)) {
+    return false;
+  }
+  updateTime();
+  inStandby = true;
+  return true;
+}
+
+/*
+ * Poll cycle: in standby, only the IRQ pin is checked, since any SPI command would
+ * terminate LPCD.
+ *
+ * return value: true, if a card was found
+ */
+bool PN5180LPCD::poll(PN5180Card *card) {
+  if (inStandby) {
+    if (HIGH != digitalRead(irqPin)) {
+      return false;
+    }
+    wakeTime = micros();
+    updateTime();
+    inStandby = false;
+
+    PN5180 &chip = reader.getChip();
+    PN5180DEBUG(F("LPCD wakeup, IRQ status=0x"));
+    PN5180DEBUG(formatHex(chip.getIRQStatus()));
+    PN5180DEBUG("\n");
+    chip.writeRegister(IRQ_ENABLE, 0);
+    chip.clearIRQStatus(0xffffffff);
+
+    numWakeups++;
+    awaitingCard = true;
+    idlePolls = 0;
+  }
+
+  if (reader.poll(card)) {
+    idlePolls = 0;
+    if (awaitingCard) {
+      wakeLatency += micros() - wakeTime;
+      numCardWakeups++;
+      awaitingCard = false;
+    }
+    return true;
+  }
+
+  if (++idlePolls >= PN5180_LPCD_IDLE_POLLS) {
+    awaitingCard = false;
+    standby();
+  }
+  return false;
+}
+
+/*
+ * Average time from wakeup to the UID of the card, in microseconds
+ */
+uint32_t PN5180LPCD::getWakeLatency() {
+  if (0 == numCardWakeups) return 0;
+  return (uint32_t)(wakeLatency / numCardWakeups);
+}
+
+/*
+ * Share of the time with the RF field on, in 1/1000: the time polling plus the
+ * field-on time of the detections in standby
+ */
+uint16_t PN5180LPCD::getDutyCycle() {
+  updateTime();
+  uint32_t total = standbyTime + activeTime;
+  if (0 == total) return 0;
+  uint64_t fieldOnUs = (uint64_t)activeTime * 1000;
+  if (wakeupCounter > 0) {
+    fieldOnUs += (uint64_t)(standbyTime / wakeupCounter) * (62 + 8 * (uint16_t)fieldOnTime);
+  }
+  return (uint16_t)(fieldOnUs / total);
+}
+
+void PN5180LPCD::clearStats() {
+  stateStart = millis();
+  standbyTime = 0;
+  activeTime = 0;
+  numWakeups = 0;
+  numCardWakeups = 0;
+  wakeLatency = 0;
+}
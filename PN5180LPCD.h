@@ -0,0 +1,64 @@
+// NAME: PN5180LPCD.h
+//
+// DESC: Low-Power Card Detection standby for the PN5180Reader.
+//
+// Copyright (c) 2018 by Andreas Trappmann. All rights reserved.
+//
+// This file is part of the PN5180 library for the Arduino environment.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+#ifndef PN5180LPCD_H
+#define PN5180LPCD_H
+
+#include "PN5180Reader.h"
+
+// Empty poll cycles after the last card, before LPCD is entered again
+#ifndef PN5180_LPCD_IDLE_POLLS
+#define PN5180_LPCD_IDLE_POLLS  (2)
+#endif
+
+class PN5180LPCD {
+
+private:
+  PN5180Reader &reader;
+  uint8_t irqPin;
+  uint16_t wakeupCounter;     // milliseconds between two card detections
+  uint8_t fieldOnTime;
+  bool inStandby;
+  bool awaitingCard;          // woken up, but no card found yet
+  uint8_t idlePolls;
+  uint32_t stateStart;        // millis() of the last switch between standby and active
+  uint32_t wakeTime;          // micros() of the last wakeup
+  uint32_t standbyTime;       // milliseconds in LPCD
+  uint32_t activeTime;        // milliseconds with the reader polling
+  uint32_t numWakeups;
+  uint32_t numCardWakeups;    // wakeups, after which a card was found
+  uint64_t wakeLatency;       // sum of the times from wakeup to UID in microseconds
+
+  void updateTime();
+
+public:
+  PN5180LPCD(PN5180Reader &reader, uint8_t irqPin);
+
+  bool begin(uint16_t wakeupCounter = 100, uint8_t fieldOnTime = 0x20, uint8_t threshold = 0x03);
+  bool standby();
+  bool poll(PN5180Card *card);
+
+  bool isStandby() { return inStandby; }
+  uint32_t getNumWakeups() { return numWakeups; }
+  uint32_t getNumFalseWakeups() { return numWakeups - numCardWakeups - (awaitingCard ? 1 : 0); }
+  uint32_t getWakeLatency();
+  uint16_t getDutyCycle();
+  void clearStats();
+};
+
+#endif /* PN5180LPCD_H */
@@ -0,0 +1,154 @@
+// NAME: PN5180Presence.cpp
+//
+// DESC: Debounced card arrival and removal events for the PN5180Reader.
+//
+// Copyright (c) 2018 by Andreas Trappmann. All rights reserved.
+//
+// This file is part of the PN5180 library for the Arduino environment.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+//#define DEBUG 1
+
+#include <Arduino.h>
+#include "PN5180Presence.h"
+#include "Debug.h"
+
+/*
+ * Each tracked card is checked in every cycle with the cheapest exchange of its
+ * protocol (see PN5180ProtocolHandler::isPresent), instead of a full activation.
+ * A card is reported as ARRIVED after arriveHits consecutive detections, and as
+ * DEPARTED after departMisses consecutive failed checks. While all tracked cards
+ * answer, the reader searches for new cards only every discoveryInterval milliseconds,
+ * with PN5180Reader::discover, which finds several cards of a protocol. The tracked
+ * ISO14443 cards are halted by their check, so they do not hide new cards. iClass
+ * finds one card per search, so only one iClass card is tracked reliably.
+ * The event handler is only called, when the state of a card changes, or every
+ * presentInterval milliseconds for PRESENT events, if enabled.
+ */
+PN5180Presence::PN5180Presence(PN5180Reader &reader, uint8_t arriveHits, uint8_t departMisses)
+              : reader(reader) {
+  this->handler = NULL;
+  this->arriveHits = (arriveHits > 0) ? arriveHits : 1;
+  this->departMisses = (departMisses > 0) ? departMisses : 1;
+  presentInterval = 0;
+  discoveryInterval = 500;
+  reset();
+}
+
+void PN5180Presence::setEventHandler(PN5180PresenceEventHandler handler) {
+  this->handler = handler;
+}
+
+/*
+ * Forget all tracked cards, no events are emitted.
+ */
+void PN5180Presence::reset() {
+  numEntries = 0;
+  lastDiscovery = millis();
+}
+
+/*
+ * One cycle: check all tracked cards, then search for new cards, if a tracked card
+ * did not answer, or the discovery interval has elapsed.
+ *
+ * return value: the number of events emitted
+ */
+uint8_t PN5180Presence::poll() {
+  uint32_t now = millis();
+  uint8_t events = 0;
+  bool allPresent = true;
+
+  for (int8_t i=numEntries-1; i>=0; i--) {
+    Entry &entry = entries[i];
+    if (reader.isPresent(&entry.card)) {
+      events += seen(entry, now);
+      continue;
+    }
+    allPresent = false;
+    if (!entry.arrived) {
+      remove(i);  // bounce, detections must be consecutive
+    }
+    else if (++entry.misses >= departMisses) {
+      if (handler) handler(PN5180_CARD_DEPARTED, &entry.card, entry.lastSeen);
+      events++;
+      remove(i);
+    }
+  }
+
+  if ((0 == numEntries) || !allPresent || ((uint32_t)(now - lastDiscovery) >= discoveryInterval)) {
+    lastDiscovery = now;
+    PN5180Card cards[PN5180_PRESENCE_MAX_CARDS];
+    uint8_t found = reader.discover(cards, PN5180_PRESENCE_MAX_CARDS);
+    for (uint8_t n=0; n<found; n++) {
+      if (find(&cards[n]) >= 0) continue;  // tracked card, answered the inventory
+      if (numEntries >= PN5180_PRESENCE_MAX_CARDS) {
+        PN5180DEBUG(F("Presence: too many cards, not tracked\n"));
+        break;
+      }
+      Entry &entry = entries[numEntries++];
+      entry.card = cards[n];
+      entry.firstSeen = now;
+      entry.hits = 0;
+      entry.arrived = false;
+      events += seen(entry, now);
+    }
+  }
+
+  return events;
+}
+
+/*
+ * Number of cards, for which ARRIVED was emitted
+ */
+uint8_t PN5180Presence::getNumCards() {
+  uint8_t num = 0;
+  for (uint8_t n=0; n<numEntries; n++) {
+    if (entries[n].arrived) num++;
+  }
+  return num;
+}
+
+uint8_t PN5180Presence::seen(Entry &entry, uint32_t now) {
+  entry.lastSeen = now;
+  entry.misses = 0;
+  if (!entry.arrived) {
+    if (++entry.hits < arriveHits) {
+      return 0;
+    }
+    entry.arrived = true;
+    entry.lastReport = now;
+    if (handler) handler(PN5180_CARD_ARRIVED, &entry.card, entry.firstSeen);
+    return 1;
+  }
+  if ((0 != presentInterval) && ((uint32_t)(now - entry.lastReport) >= presentInterval)) {
+    entry.lastReport = now;
+    if (handler) handler(PN5180_CARD_PRESENT, &entry.card, now);
+    return 1;
+  }
+  return 0;
+}
+
+void PN5180Presence::remove(uint8_t index) {
+  numEntries--;
+  if (index < numEntries) {
+    entries[index] = entries[numEntries];
+  }
+}
+
+int8_t PN5180Presence::find(const PN5180Card *card) {
+  for (uint8_t n=0; n<numEntries; n++) {
+    if ((entries[n].card.protocol == card->protocol) &&
+        (entries[n].card.uidLength == card->uidLength) &&
+        (0 == memcmp(entries[n].card.uid, card->uid, card->uidLength))) return n;
+  }
+  return -1;
+}
@@ -0,0 +1,87 @@
+// NAME: PN5180Presence.h
+//
+// DESC: Debounced card arrival and removal events for the PN5180Reader.
+//
+// Copyright (c) 2018 by Andreas Trappmann. All rights reserved.
+//
+// This file is part of the PN5180 library for the Arduino environment.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+#ifndef PN5180PRESENCE_H
+#define PN5180PRESENCE_H
+
+#include "PN5180Reader.h"
+
+// Max. number of cards tracked at the same time
+#ifndef PN5180_PRESENCE_MAX_CARDS
+#if defined(__AVR__)
+#define PN5180_PRESENCE_MAX_CARDS  (4)
+#else
+#define PN5180_PRESENCE_MAX_CARDS  (8)
+#endif
+#endif
+
+enum PN5180PresenceEvent {
+  PN5180_CARD_ARRIVED = 0,
+  PN5180_CARD_PRESENT = 1,
+  PN5180_CARD_DEPARTED = 2
+};
+
+// timestamp: millis() of first detection for ARRIVED, of the check for PRESENT,
+// of last detection for DEPARTED
+typedef void (*PN5180PresenceEventHandler)(PN5180PresenceEvent event, const PN5180Card *card, uint32_t timestamp);
+
+class PN5180Presence {
+
+private:
+  struct Entry {
+    PN5180Card card;
+    uint32_t firstSeen;
+    uint32_t lastSeen;
+    uint32_t lastReport;  // millis() of ARRIVED or of the last PRESENT event
+    uint8_t hits;         // consecutive detections before arrival
+    uint8_t misses;       // consecutive failed presence checks
+    bool arrived;         // ARRIVED was emitted
+  };
+
+  PN5180Reader &reader;
+  PN5180PresenceEventHandler handler;
+  uint8_t arriveHits;
+  uint8_t departMisses;
+  uint16_t presentInterval;
+  uint16_t discoveryInterval;
+  uint32_t lastDiscovery;
+
+  Entry entries[PN5180_PRESENCE_MAX_CARDS];
+  uint8_t numEntries;
+
+public:
+  PN5180Presence(PN5180Reader &reader, uint8_t arriveHits = 2, uint8_t departMisses = 3);
+
+  void setEventHandler(PN5180PresenceEventHandler handler);
+  // milliseconds between PRESENT events of a card, 0 for no PRESENT events
+  void setPresentInterval(uint16_t presentInterval) { this->presentInterval = presentInterval; }
+  // milliseconds between polls for new cards, while all tracked cards are present
+  void setDiscoveryInterval(uint16_t discoveryInterval) { this->discoveryInterval = discoveryInterval; }
+  void reset();
+
+  uint8_t poll();
+
+  uint8_t getNumCards();
+
+private:
+  uint8_t seen(Entry &entry, uint32_t now);
+  void remove(uint8_t index);
+  int8_t find(const PN5180Card *card);
+};
+
+#endif /* PN5180PRESENCE_H */
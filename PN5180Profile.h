@@ -0,0 +1,80 @@
+// NAME: PN5180Profile.h
+//
+// DESC: Register settings of the protocols, as applied by PN5180::applyProfile.
+//
+// Copyright (c) 2018 by Andreas Trappmann. All rights reserved.
+//
+// This file is part of the PN5180 library for the Arduino environment.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+#ifndef PN5180PROFILE_H
+#define PN5180PROFILE_H
+
+#include "PN5180.h"
+
+// Registers, which are set by a profile, in addition to the RF configuration
+#define PN5180_PROFILE_CRC_TX         (1<<0)  // CRC_TX_CONFIG
+#define PN5180_PROFILE_CRC_RX         (1<<1)  // CRC_RX_CONFIG
+
+/*
+ * Register settings of a protocol. Registers without flag keep the values of the
+ * RF configuration. Registers with flag and SYSTEM_CONFIG are modified by clearing
+ * and then setting bits, a register with all bits cleared is written with the set bits.
+ */
+struct PN5180Profile {
+  uint8_t rfTx;               // LOAD_RF_CONFIG transmitter configuration
+  uint8_t rfRx;               // LOAD_RF_CONFIG receiver configuration
+  uint8_t flags;              // PN5180_PROFILE_*, registers set by the profile
+  uint32_t crcTxClear;
+  uint32_t crcTxSet;
+  uint32_t crcRxClear;
+  uint32_t crcRxSet;
+  uint32_t systemConfigClear; // bits cleared in SYSTEM_CONFIG
+  uint32_t systemConfigSet;   // bits set in SYSTEM_CONFIG, after clearing
+};
+
+constexpr PN5180Profile PN5180_PROFILE_ISO15693 = {
+  0x0D, 0x8D, 0,
+  0, 0, 0, 0,
+  SYSTEM_CONFIG_COMMAND_MASK, SYSTEM_CONFIG_TRANSCEIVE
+};
+
+// CRC off for REQA/WUPA and anticollision
+constexpr PN5180Profile PN5180_PROFILE_ISO14443A = {
+  0x00, 0x80, PN5180_PROFILE_CRC_TX | PN5180_PROFILE_CRC_RX,
+  CRC_ENABLE, 0, CRC_ENABLE, 0,
+  SYSTEM_CONFIG_MFC_CRYPTO_ON, 0
+};
+
+// FeliCa 424 kbit/s
+constexpr PN5180Profile PN5180_PROFILE_FELICA = {
+  0x09, 0x89, 0,
+  0, 0, 0, 0,
+  SYSTEM_CONFIG_MFC_CRYPTO_ON, 0
+};
+
+// ISO15693 RF configuration with the CRC off, iClass checks the CRC of IDENTIFY and
+// SELECT in software. SEND_DATA starts the Transceive command, SYSTEM_CONFIG is unchanged.
+constexpr PN5180Profile PN5180_PROFILE_ICLASS = {
+  0x0D, 0x8D, PN5180_PROFILE_CRC_TX | PN5180_PROFILE_CRC_RX,
+  0xFFFFFFFF, 0, 0xFFFFFFFF, 0,
+  0, 0
+};
+
+// iClass with the CRC of READ and READ4 done by the PN5180
+constexpr PN5180Profile PN5180_PROFILE_ICLASS_CRC = {
+  0x0D, 0x8D, PN5180_PROFILE_CRC_TX | PN5180_PROFILE_CRC_RX,
+  0xFFFFFFFF, 0x00000069, 0xFFFFFFFF, 0x00000029,
+  0, 0
+};
+
+#endif /* PN5180PROFILE_H */
@@ -0,0 +1,329 @@
+// NAME: PN5180Reader.cpp
+//
+// DESC: Multi-protocol polling on one PN5180 with pluggable protocol handlers.
+//
+// Copyright (c) 2018 by Andreas Trappmann. All rights reserved.
+//
+// This file is part of the PN5180 library for the Arduino environment.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+//#define DEBUG 1
+
+#include <Arduino.h>
+#include "PN5180Reader.h"
+#include "PN5180EventQueue.h"
+#include "Debug.h"
+
+/*
+ * Default presence check: poll and compare the UID
+ */
+bool PN5180ProtocolHandler::isPresent(const PN5180Card *card) {
+  PN5180Card found;
+  if (!poll(&found)) {
+    return false;
+  }
+  return (found.uidLength == card->uidLength) && (0 == memcmp(found.uid, card->uid, card->uidLength));
+}
+
+/*
+ * Default discovery: one card with a poll
+ */
+uint8_t PN5180ProtocolHandler::discover(PN5180Card *cards, uint8_t maxCards) {
+  if ((0 == maxCards) || !poll(&cards[0])) {
+    return 0;
+  }
+  return 1;
+}
+
+bool PN5180ISO15693Handler::poll(PN5180Card *card) {
+  if (ISO15693_EC_OK != nfc.getInventory(card->uid)) {
+    return false;
+  }
+  card->uidLength = 8;
+  return true;
+}
+
+// Addressed RESET TO READY, answered only by the card with this UID
+bool PN5180ISO15693Handler::isPresent(const PN5180Card *card) {
+  return (ISO15693_EC_OK == nfc.resetToReady((uint8_t *)card->uid));
+}
+
+/*
+ * 16 slot inventory, all cards in the field answer, including the known ones
+ */
+uint8_t PN5180ISO15693Handler::discover(PN5180Card *cards, uint8_t maxCards) {
+  uint8_t uids[8*PN5180_READER_MAX_CARDS];
+  uint8_t numTags = 0;
+  if (maxCards > PN5180_READER_MAX_CARDS) maxCards = PN5180_READER_MAX_CARDS;
+  if (ISO15693_EC_OK != nfc.getInventoryMultiple(uids, maxCards, &numTags)) {
+    return 0;
+  }
+  for (uint8_t n=0; n<numTags; n++) {
+    cards[n].uidLength = 8;
+    for (int i=0; i<8; i++) cards[n].uid[i] = uids[8*n + i];
+  }
+  return numTags;
+}
+
+/*
+ * The card is sent to HALT after activation, so it answers the WUPA of the next poll
+ */
+bool PN5180ISO14443Handler::poll(PN5180Card *card) {
+  ISO14443Card iso14443;
+  if (nfc.activateTypeA(&iso14443, 1) < 4) {
+    return false;
+  }
+  nfc.mifareHalt();
+  card->uidLength = iso14443.uidLength;
+  for (int i=0; i<iso14443.uidLength; i++) card->uid[i] = iso14443.uid[i];
+  return true;
+}
+
+/*
+ * The halted card is selected again with its known UID, without anticollision
+ */
+bool PN5180ISO14443Handler::isPresent(const PN5180Card *card) {
+  ISO14443Card iso14443;
+  iso14443.uidLength = card->uidLength;
+  for (int i=0; i<card->uidLength; i++) iso14443.uid[i] = card->uid[i];
+  if (!nfc.reselect(&iso14443)) {
+    return false;
+  }
+  nfc.mifareHalt();
+  return true;
+}
+
+/*
+ * REQA is not answered by halted cards, i.e. by the cards checked with isPresent,
+ * or found before. Each found card is halted, so the next REQA finds another one.
+ */
+uint8_t PN5180ISO14443Handler::discover(PN5180Card *cards, uint8_t maxCards) {
+  uint8_t num = 0;
+  while (num < maxCards) {
+    ISO14443Card iso14443;
+    if (nfc.activateTypeA(&iso14443, 0) < 4) {
+      break;
+    }
+    nfc.mifareHalt();
+    cards[num].uidLength = iso14443.uidLength;
+    for (int i=0; i<iso14443.uidLength; i++) cards[num].uid[i] = iso14443.uid[i];
+    num++;
+  }
+  return num;
+}
+
+bool PN5180FeliCaHandler::poll(PN5180Card *card) {
+  FeliCaCard felica;
+  if (0 == nfc.polling(&felica, 1, 1)) {
+    return false;
+  }
+  card->uidLength = 8;
+  for (int i=0; i<8; i++) card->uid[i] = felica.idm[i];
+  return true;
+}
+
+// Request Response addressed by IDm, answered only by this card
+bool PN5180FeliCaHandler::isPresent(const PN5180Card *card) {
+  return nfc.requestResponse(card->uid);
+}
+
+/*
+ * POLLING with the adaptive number of time slots, all cards in the field answer
+ */
+uint8_t PN5180FeliCaHandler::discover(PN5180Card *cards, uint8_t maxCards) {
+  FeliCaCard felica[PN5180_READER_MAX_CARDS];
+  if (maxCards > PN5180_READER_MAX_CARDS) maxCards = PN5180_READER_MAX_CARDS;
+  uint8_t num = nfc.polling(felica, maxCards);
+  for (uint8_t n=0; n<num; n++) {
+    cards[n].uidLength = 8;
+    for (int i=0; i<8; i++) cards[n].uid[i] = felica[n].idm[i];
+  }
+  return num;
+}
+
+bool PN5180iClassHandler::poll(PN5180Card *card) {
+  if (ICLASS_EC_OK != nfc.ActivateAll()) return false;
+  if (ICLASS_EC_OK != nfc.Identify(card->uid)) return false;
+  if (ICLASS_EC_OK != nfc.Select(card->uid)) return false;
+  card->uidLength = 8;
+  return true;
+}
+
+/*
+ * All protocol objects and chip must use the same pins. Only the reader calls begin(),
+ * reset() and switches the RF field, the protocol objects are used for their commands.
+ * chip can be any of the protocol objects.
+ */
+PN5180Reader::PN5180Reader(PN5180 &chip) : chip(chip) {
+  numHandlers = 0;
+  current = -1;
+  fieldOn = false;
+  eventQueue = NULL;
+  clearStats();
+}
+
+bool PN5180Reader::addHandler(PN5180ProtocolHandler &handler) {
+  if (numHandlers >= PN5180_READER_MAX_HANDLERS) {
+    return false;
+  }
+  handlers[numHandlers++] = &handler;
+  return true;
+}
+
+void PN5180Reader::begin() {
+  chip.begin();
+  reset();
+}
+
+void PN5180Reader::reset() {
+  chip.reset();
+  current = -1;
+  fieldOn = false;
+}
+
+/*
+ * Switch the RF field off, e.g. before LPCD. The next poll switches it on again and
+ * loads the RF configuration of the protocol.
+ */
+bool PN5180Reader::fieldOff() {
+  current = -1;
+  if (fieldOn) {
+    if (!chip.setRF_off()) {
+      return false;
+    }
+    fieldOn = false;
+  }
+  return true;
+}
+
+void PN5180Reader::clearStats() {
+  memset(stats, 0, sizeof(stats));
+  numSwitches = 0;
+}
+
+/*
+ * The RF configuration is loaded only, if the protocol changes. The RF field is
+ * switched on once, after the first RF configuration was loaded.
+ */
+bool PN5180Reader::switchTo(uint8_t index) {
+  if (current == index) {
+    return true;
+  }
+  PN5180DEBUG(F("Reader: switch to protocol "));
+  PN5180DEBUG(handlers[index]->getProtocol());
+  PN5180DEBUG("\n");
+
+  current = -1;
+  if (!handlers[index]->loadProtocolConfig()) {
+    return false;
+  }
+  if (!fieldOn) {
+    if (!chip.setRF_on()) {
+      return false;
+    }
+    fieldOn = true;
+  }
+  current = index;
+  numSwitches++;
+  return true;
+}
+
+/*
+ * Poll with one handler. cycleStart is the micros() at the start of the poll
+ * cycle, or of the first cycle, which could have found the card, e.g. with the
+ * scheduler. It is used for the discovery latency.
+ */
+bool PN5180Reader::pollHandler(uint8_t index, PN5180Card *card, uint32_t cycleStart) {
+  uint32_t start = micros();
+  bool found = switchTo(index) && handlers[index]->poll(card);
+  uint32_t now = micros();
+
+  stats[index].numPolls++;
+  stats[index].pollTime += now - start;
+  if (found) {
+    card->protocol = handlers[index]->getProtocol();
+    stats[index].numHits++;
+    stats[index].latency += now - cycleStart;
+    if (eventQueue) eventQueue->push(card);
+  }
+  return found;
+}
+
+/*
+ * One poll cycle through all protocols, in the order the handlers were added.
+ *
+ * return value: true, if a card was found, the cycle stops at the first card
+ */
+bool PN5180Reader::poll(PN5180Card *card) {
+  uint32_t cycleStart = micros();
+  // start with the protocol, which is still loaded
+  uint8_t first = (current >= 0) ? current : 0;
+  for (uint8_t n=0; n<numHandlers; n++) {
+    uint8_t index = (first + n) % numHandlers;
+    if (pollHandler(index, card, cycleStart)) {
+      return true;
+    }
+  }
+  card->protocol = PN5180_PROTOCOL_NONE;
+  card->uidLength = 0;
+  return false;
+}
+
+/*
+ * Find the cards of all protocols, which are in the field. Unlike poll, the cycle
+ * does not stop at the first card. Cards, which are checked with isPresent, are
+ * not found again by ISO14443, but by ISO15693 and FeliCa, see the discover of the handlers.
+ *
+ * return value: number of cards found
+ */
+uint8_t PN5180Reader::discover(PN5180Card *cards, uint8_t maxCards) {
+  uint32_t cycleStart = micros();
+  uint8_t num = 0;
+  uint8_t first = (current >= 0) ? current : 0;
+  for (uint8_t n=0; (n<numHandlers) && (num<maxCards); n++) {
+    uint8_t index = (first + n) % numHandlers;
+    uint32_t start = micros();
+    uint8_t found = switchTo(index) ? handlers[index]->discover(&cards[num], maxCards - num) : 0;
+    uint32_t now = micros();
+
+    stats[index].numPolls++;
+    stats[index].pollTime += now - start;
+    for (uint8_t i=num; i<num+found; i++) {
+      cards[i].protocol = handlers[index]->getProtocol();
+      stats[index].numHits++;
+      stats[index].latency += now - cycleStart;
+      if (eventQueue) eventQueue->push(&cards[i]);
+    }
+    num += found;
+  }
+  return num;
+}
+
+/*
+ * Check a known card with the presence check of its protocol
+ */
+bool PN5180Reader::isPresent(const PN5180Card *card) {
+  for (uint8_t index=0; index<numHandlers; index++) {
+    if (handlers[index]->getProtocol() != card->protocol) continue;
+    return switchTo(index) && handlers[index]->isPresent(card);
+  }
+  return false;
+}
+
+/*
+ * Average time from start of a poll cycle to detection of a card of this protocol,
+ * in microseconds
+ */
+uint32_t PN5180Reader::getDiscoveryLatency(uint8_t index) {
+  if (0 == stats[index].numHits) return 0;
+  return (uint32_t)(stats[index].latency / stats[index].numHits);
+}
@@ -0,0 +1,170 @@
+// NAME: PN5180Reader.h
+//
+// DESC: Multi-protocol polling on one PN5180 with pluggable protocol handlers.
+//
+// Copyright (c) 2018 by Andreas Trappmann. All rights reserved.
+//
+// This file is part of the PN5180 library for the Arduino environment.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+#ifndef PN5180READER_H
+#define PN5180READER_H
+
+#include "PN5180.h"
+#include "PN5180ISO15693.h"
+#include "PN5180ISO14443.h"
+#include "PN5180FeliCa.h"
+#include "PN5180iClass.h"
+
+// Max. number of protocol handlers
+#ifndef PN5180_READER_MAX_HANDLERS
+#define PN5180_READER_MAX_HANDLERS  (4)
+#endif
+
+// Max. number of cards of one protocol found by PN5180Reader::discover
+#ifndef PN5180_READER_MAX_CARDS
+#if defined(__AVR__)
+#define PN5180_READER_MAX_CARDS  (4)
+#else
+#define PN5180_READER_MAX_CARDS  (8)
+#endif
+#endif
+
+enum PN5180Protocol {
+  PN5180_PROTOCOL_NONE = 0,
+  PN5180_PROTOCOL_ISO15693 = 1,
+  PN5180_PROTOCOL_ISO14443A = 2,
+  PN5180_PROTOCOL_FELICA = 3,
+  PN5180_PROTOCOL_ICLASS = 4
+};
+
+class PN5180EventQueue;
+
+struct PN5180Card {
+  PN5180Protocol protocol;
+  uint8_t uidLength;
+  uint8_t uid[10];    // UID, IDm or CSN, in the byte order of the protocol class
+};
+
+/*
+ * A protocol handler switches the PN5180 to its protocol and polls for one card.
+ * isPresent checks a known card, by default with a poll. discover finds all cards
+ * in the field, which were not checked with isPresent before, by default with a poll.
+ */
+class PN5180ProtocolHandler {
+public:
+  virtual ~PN5180ProtocolHandler() {}
+  virtual PN5180Protocol getProtocol() = 0;
+  // load the RF configuration, the RF field is already on
+  virtual bool loadProtocolConfig() = 0;
+  virtual bool poll(PN5180Card *card) = 0;
+  virtual bool isPresent(const PN5180Card *card);
+  virtual uint8_t discover(PN5180Card *cards, uint8_t maxCards);
+};
+
+class PN5180ISO15693Handler : public PN5180ProtocolHandler {
+private:
+  PN5180ISO15693 &nfc;
+public:
+  PN5180ISO15693Handler(PN5180ISO15693 &nfc) : nfc(nfc) {}
+  PN5180Protocol getProtocol() { return PN5180_PROTOCOL_ISO15693; }
+  bool loadProtocolConfig() { return nfc.loadProtocolConfig(); }
+  bool poll(PN5180Card *card);
+  bool isPresent(const PN5180Card *card);
+  uint8_t discover(PN5180Card *cards, uint8_t maxCards);
+};
+
+class PN5180ISO14443Handler : public PN5180ProtocolHandler {
+private:
+  PN5180ISO14443 &nfc;
+public:
+  PN5180ISO14443Handler(PN5180ISO14443 &nfc) : nfc(nfc) {}
+  PN5180Protocol getProtocol() { return PN5180_PROTOCOL_ISO14443A; }
+  bool loadProtocolConfig() { return nfc.loadProtocolConfig(); }
+  bool poll(PN5180Card *card);
+  bool isPresent(const PN5180Card *card);
+  uint8_t discover(PN5180Card *cards, uint8_t maxCards);
+};
+
+class PN5180FeliCaHandler : public PN5180ProtocolHandler {
+private:
+  PN5180FeliCa &nfc;
+public:
+  PN5180FeliCaHandler(PN5180FeliCa &nfc) : nfc(nfc) {}
+  PN5180Protocol getProtocol() { return PN5180_PROTOCOL_FELICA; }
+  bool loadProtocolConfig() { return nfc.loadProtocolConfig(); }
+  bool poll(PN5180Card *card);
+  bool isPresent(const PN5180Card *card);
+  uint8_t discover(PN5180Card *cards, uint8_t maxCards);
+};
+
+class PN5180iClassHandler : public PN5180ProtocolHandler {
+private:
+  PN5180iClass &nfc;
+public:
+  PN5180iClassHandler(PN5180iClass &nfc) : nfc(nfc) {}
+  PN5180Protocol getProtocol() { return PN5180_PROTOCOL_ICLASS; }
+  bool loadProtocolConfig() { return nfc.loadProtocolConfig(); }
+  bool poll(PN5180Card *card);
+};
+
+/*
+ * Statistics of one protocol handler, times in microseconds. The sums are 64 bit,
+ * a 32 bit sum of microseconds overflows after 71 minutes.
+ */
+struct PN5180ProtocolStats {
+  uint32_t numPolls;
+  uint32_t numHits;
+  uint64_t pollTime;      // sum of all poll durations, including protocol switches
+  uint64_t latency;       // sum of the times from start of poll cycle to detection
+};
+
+class PN5180Reader {
+
+private:
+  PN5180 &chip;
+  PN5180ProtocolHandler *handlers[PN5180_READER_MAX_HANDLERS];
+  PN5180ProtocolStats stats[PN5180_READER_MAX_HANDLERS];
+  uint8_t numHandlers;
+  int8_t current;          // index of the handler, whose protocol is loaded, -1 if none
+  bool fieldOn;
+  uint32_t numSwitches;
+  PN5180EventQueue *eventQueue;
+
+public:
+  PN5180Reader(PN5180 &chip);
+
+  bool addHandler(PN5180ProtocolHandler &handler);
+  void begin();
+  void reset();
+  bool fieldOff();
+  PN5180 &getChip() { return chip; }
+  // each detected card is pushed into the queue
+  void setEventQueue(PN5180EventQueue *eventQueue) { this->eventQueue = eventQueue; }
+
+  bool poll(PN5180Card *card);
+  bool pollHandler(uint8_t index, PN5180Card *card, uint32_t cycleStart);
+  uint8_t discover(PN5180Card *cards, uint8_t maxCards);
+  bool isPresent(const PN5180Card *card);
+
+  uint8_t getNumHandlers() { return numHandlers; }
+  PN5180Protocol getProtocol(uint8_t index) { return handlers[index]->getProtocol(); }
+  const PN5180ProtocolStats *getStats(uint8_t index) { return &stats[index]; }
+  uint32_t getDiscoveryLatency(uint8_t index);
+  uint32_t getNumSwitches() { return numSwitches; }
+  void clearStats();
+
+private:
+  bool switchTo(uint8_t index);
+};
+
+#endif /* PN5180READER_H */
@@ -0,0 +1,105 @@
+// NAME: PN5180Scheduler.cpp
+//
+// DESC: Adaptive protocol scheduler for the multi-protocol PN5180Reader.
+//
+// Copyright (c) 2018 by Andreas Trappmann. All rights reserved.
+//
+// This file is part of the PN5180 library for the Arduino environment.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+//#define DEBUG 1
+
+#include <Arduino.h>
+#include "PN5180Scheduler.h"
+#include "Debug.h"
+
+/*
+ * Each protocol has a hit rate, the moving average of detections per poll over
+ * the last ~8 polls. In each cycle the protocols are polled in the order of their
+ * hit rate, so the most frequent protocol is polled first. The protocol with the
+ * highest hit rate is polled in every cycle. The others collect their hit rate,
+ * at least the exploration floor, as credit per cycle, and are polled, when the
+ * credit reaches one. So with a floor of 32/256, a protocol without any hits
+ * is still polled every 8th cycle.
+ */
+PN5180Scheduler::PN5180Scheduler(PN5180Reader &reader, uint8_t explorationFloor)
+                : reader(reader) {
+  this->explorationFloor = explorationFloor;
+  reset();
+}
+
+void PN5180Scheduler::reset() {
+  for (int i=0; i<PN5180_READER_MAX_HANDLERS; i++) {
+    hitRate[i] = PN5180_SCHEDULER_ONE; // poll all protocols at start
+    credit[i] = 0;
+    pollableValid[i] = false;
+  }
+  numDetections = 0;
+  detectionTime = 0;
+}
+
+bool PN5180Scheduler::poll(PN5180Card *card) {
+  uint32_t cycleStart = micros();
+  uint8_t num = reader.getNumHandlers();
+  for (uint8_t i=0; i<num; i++) {
+    if (!pollableValid[i]) {
+      pollableSince[i] = cycleStart;
+      pollableValid[i] = true;
+    }
+  }
+
+  // order by hit rate, highest first
+  uint8_t order[PN5180_READER_MAX_HANDLERS];
+  for (uint8_t i=0; i<num; i++) {
+    uint8_t j = i;
+    while ((j > 0) && (hitRate[order[j-1]] < hitRate[i])) {
+      order[j] = order[j-1];
+      j--;
+    }
+    order[j] = i;
+  }
+
+  for (uint8_t n=0; n<num; n++) {
+    uint8_t index = order[n];
+    if (n > 0) {
+      credit[index] += (hitRate[index] > explorationFloor) ? hitRate[index] : explorationFloor;
+      if (credit[index] < PN5180_SCHEDULER_ONE) {
+        continue;
+      }
+      credit[index] -= PN5180_SCHEDULER_ONE;
+    }
+
+    bool found = reader.pollHandler(index, card, pollableSince[index]);
+    pollableValid[index] = false;
+    hitRate[index] -= hitRate[index] / 8;
+    if (found) {
+      hitRate[index] += PN5180_SCHEDULER_ONE / 8;
+      numDetections++;
+      detectionTime += micros() - pollableSince[index];
+      return true;
+    }
+  }
+
+  card->protocol = PN5180_PROTOCOL_NONE;
+  card->uidLength = 0;
+  return false;
+}
+
+/*
+ * Average time to the detection of a card, in microseconds, over all protocols.
+ * It is measured from the start of the first cycle after the previous poll of the
+ * protocol, so the cycles, which skipped the protocol, are included.
+ */
+uint32_t PN5180Scheduler::getTimeToFirstDetection() {
+  if (0 == numDetections) return 0;
+  return (uint32_t)(detectionTime / numDetections);
+}
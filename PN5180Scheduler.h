@@ -0,0 +1,53 @@
+// NAME: PN5180Scheduler.h
+//
+// DESC: Adaptive protocol scheduler for the multi-protocol PN5180Reader.
+//
+// Copyright (c) 2018 by Andreas Trappmann. All rights reserved.
+//
+// This file is part of the PN5180 library for the Arduino environment.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+#ifndef PN5180SCHEDULER_H
+#define PN5180SCHEDULER_H
+
+#include "PN5180Reader.h"
+
+// Hit rates and exploration floor are fractions of 256
+#define PN5180_SCHEDULER_ONE  (256)
+
+class PN5180Scheduler {
+
+private:
+  PN5180Reader &reader;
+  uint8_t explorationFloor;
+  uint16_t hitRate[PN5180_READER_MAX_HANDLERS];  // moving average of hits per poll
+  uint16_t credit[PN5180_READER_MAX_HANDLERS];
+  // micros() of the first cycle after the last poll of the protocol, a card can be
+  // detected since then, also in cycles which skip the protocol
+  uint32_t pollableSince[PN5180_READER_MAX_HANDLERS];
+  bool pollableValid[PN5180_READER_MAX_HANDLERS];
+  uint32_t numDetections;
+  uint64_t detectionTime;                        // sum of times to detection in microseconds
+
+public:
+  PN5180Scheduler(PN5180Reader &reader, uint8_t explorationFloor = 32);
+
+  void setExplorationFloor(uint8_t explorationFloor) { this->explorationFloor = explorationFloor; }
+  void reset();
+
+  bool poll(PN5180Card *card);
+
+  uint16_t getHitRate(uint8_t index) { return hitRate[index]; }
+  uint32_t getTimeToFirstDetection();
+};
+
+#endif /* PN5180SCHEDULER_H */
@@ -20,17 +20,19 @@
 
 #include <Arduino.h>
 #include "PN5180iClass.h"
+#include "PN5180CRC.h"
+#include "PN5180Profile.h"
 #include "Debug.h"
 
 PN5180iClass::PN5180iClass(uint8_t SSpin, uint8_t BUSYpin, uint8_t RSTpin) : PN5180(SSpin, BUSYpin, RSTpin) {
+  sessionState = ICLASS_SESSION_NONE;
 }
 
 iClassErrorCode PN5180iClass::ActivateAll() {
   PN5180DEBUG(F("Activate All...\n"));
 
   // Disable CRCs
-  writeRegister(CRC_TX_CONFIG, 0x00000000);
-  writeRegister(CRC_RX_CONFIG, 0x00000000);
+  applyProfile(PN5180_PROFILE_ICLASS);
 
   uint8_t actall[] = {ICLASS_CMD_ACTALL};
 
@@ -46,8 +48,8 @@ iClassErrorCode PN5180iClass::ActivateAll() {
 iClassErrorCode PN5180iClass::Identify(uint8_t *csn) {
   PN5180DEBUG(F("Identify...\n"));
 
-  writeRegister(CRC_TX_CONFIG, 0x00000000);
-  writeRegister(CRC_RX_CONFIG, 0x00000029);
+  // Disable CRCs, the CRC of the response is checked in software
+  applyProfile(PN5180_PROFILE_ICLASS);
 
   uint8_t identify[] = {ICLASS_CMD_IDENTIFY};
 
@@ -56,10 +58,15 @@ iClassErrorCode PN5180iClass::Identify(uint8_t *csn) {
   }
 
   uint8_t *readBuffer;
-  iClassErrorCode rc = issueiClassCommand(identify, sizeof(identify), &readBuffer);
+  uint16_t len;
+  iClassErrorCode rc = issueiClassCommand(identify, sizeof(identify), &readBuffer, &len);
   if (ICLASS_EC_OK != rc) {
     return rc;
   }
+  if ((len != 10) || !PN5180CRC::checkiClass(readBuffer, 10)) {
+    PN5180DEBUG(F("*** CRC error in Identify!\n"));
+    return ICLASS_EC_UNKNOWN_ERROR;
+  }
 
   // Anticollision CSN
   for (int i=0; i<8; i++) {
@@ -73,8 +80,8 @@ iClassErrorCode PN5180iClass::Identify(uint8_t *csn) {
 iClassErrorCode PN5180iClass::Select(uint8_t *csn) {
   PN5180DEBUG(F("Select...\n"));
 
-  writeRegister(CRC_TX_CONFIG, 0x00000000);
-  writeRegister(CRC_RX_CONFIG, 0x00000029);
+  // Disable CRCs, the CRC of the response is checked in software
+  applyProfile(PN5180_PROFILE_ICLASS);
 
   uint8_t select[] = {ICLASS_CMD_SELECT, 1, 2, 3, 4, 5, 6, 7, 8};
 
@@ -83,10 +90,15 @@ iClassErrorCode PN5180iClass::Select(uint8_t *csn) {
   }
 
   uint8_t *readBuffer;
-  iClassErrorCode rc = issueiClassCommand(select, sizeof(select), &readBuffer);
+  uint16_t len;
+  iClassErrorCode rc = issueiClassCommand(select, sizeof(select), &readBuffer, &len);
   if (ICLASS_EC_OK != rc) {
     return rc;
   }
+  if ((len != 10) || !PN5180CRC::checkiClass(readBuffer, 10)) {
+    PN5180DEBUG(F("*** CRC error in Select!\n"));
+    return ICLASS_EC_UNKNOWN_ERROR;
+  }
 
   // Replace with real CSN
   for (int i=0; i<8; i++) {
@@ -100,8 +112,7 @@ iClassErrorCode PN5180iClass::ReadCheck(uint8_t *ccnr) {
   PN5180DEBUG(F("ReadCheck...\n"));
 
   // Disable CRCs
-  writeRegister(CRC_TX_CONFIG, 0x00000000);
-  writeRegister(CRC_RX_CONFIG, 0x00000000);
+  applyProfile(PN5180_PROFILE_ICLASS);
 
   uint8_t readcheck[] = {ICLASS_CMD_READCHECK, 0x02};
 
@@ -122,8 +133,7 @@ iClassErrorCode PN5180iClass::Check(uint8_t *mac) {
   PN5180DEBUG(F("Check...\n"));
 
   // Disable CRCs
-  writeRegister(CRC_TX_CONFIG, 0x00000000);
-  writeRegister(CRC_RX_CONFIG, 0x00000000);
+  applyProfile(PN5180_PROFILE_ICLASS);
 
   uint8_t check[] = {ICLASS_CMD_CHECK, 0, 0, 0, 0, 1, 2, 3, 4};
 
@@ -144,8 +154,8 @@ iClassErrorCode PN5180iClass::Check(uint8_t *mac) {
 iClassErrorCode PN5180iClass::Read(uint8_t blockNum, uint8_t *blockData) {
   PN5180DEBUG(F("Read...\n"));
 
-  writeRegister(CRC_TX_CONFIG, 0x00000069);
-  writeRegister(CRC_RX_CONFIG, 0x00000029);
+  // Enable CRCs
+  applyProfile(PN5180_PROFILE_ICLASS_CRC);
 
   uint8_t read[] = {ICLASS_CMD_READ, blockNum};
 
@@ -162,12 +172,44 @@ iClassErrorCode PN5180iClass::Read(uint8_t blockNum, uint8_t *blockData) {
   return ICLASS_EC_OK;
 }
 
+/*
+ * READ4 - reads 4 consecutive blocks with one command
+ *
+ * blockData : receives 32 bytes
+ */
+iClassErrorCode PN5180iClass::Read4(uint8_t blockNum, uint8_t *blockData) {
+  PN5180DEBUG(F("Read4...\n"));
+
+  // Enable CRCs
+  applyProfile(PN5180_PROFILE_ICLASS_CRC);
+
+  uint8_t read4[] = {ICLASS_CMD_READ4, blockNum};
+
+  uint8_t *readBuffer;
+  uint16_t len;
+  iClassErrorCode rc = issueiClassCommand(read4, sizeof(read4), &readBuffer, &len);
+  if (ICLASS_EC_OK != rc) {
+    return rc;
+  }
+  // 4 blocks of 8 bytes, the CRC is checked and removed by the PN5180
+  if (len != 32) {
+    return ICLASS_EC_UNKNOWN_ERROR;
+  }
+
+  for (int i=0; i<32; i++) {
+    blockData[i] = readBuffer[i];
+  }
+
+  return ICLASS_EC_OK;
+}
+
 iClassErrorCode PN5180iClass::Halt() {
   PN5180DEBUG(F("Halt...\n"));
 
+  sessionState = ICLASS_SESSION_NONE;
+
   // Disable CRCs
-  writeRegister(CRC_TX_CONFIG, 0x00000000);
-  writeRegister(CRC_RX_CONFIG, 0x00000000);
+  applyProfile(PN5180_PROFILE_ICLASS);
 
   uint8_t halt[] = {ICLASS_CMD_HALT};
 
@@ -180,18 +222,108 @@ iClassErrorCode PN5180iClass::Halt() {
   return ICLASS_EC_OK;
 }
 
-iClassErrorCode PN5180iClass::issueiClassCommand(uint8_t *cmd, uint8_t cmdLen, uint8_t **resultPtr) {
+/*
+ * Open a session with the card in the field: ActivateAll, Identify and Select, followed
+ * by ReadCheck and Check, if computeMac is given. If the session is still open from a
+ * previous call, the selected card is only checked with a READ of block 0, and its CSN
+ * is returned, if it answers. Otherwise a new session is opened.
+ * The session is closed by Close(), Halt(), or if a command of the session fails,
+ * e.g. because the card has left the field.
+ *
+ * csn : receives the 8 byte CSN
+ */
+iClassErrorCode PN5180iClass::Open(uint8_t *csn, iClassMacFunction computeMac) {
+  iClassSessionState wanted = computeMac ? ICLASS_SESSION_AUTHENTICATED : ICLASS_SESSION_SELECTED;
+  if (sessionState >= wanted) {
+    // the selected card is still in the field, if it answers READ of block 0 with its CSN
+    uint8_t block0[8];
+    if ((ICLASS_EC_OK == Read(0, block0)) && (0 == memcmp(block0, sessionCSN, 8))) {
+      for (int i=0; i<8; i++) csn[i] = sessionCSN[i];
+      return ICLASS_EC_OK;
+    }
+    PN5180DEBUG(F("iClass session card has left the field\n"));
+  }
+
+  sessionState = ICLASS_SESSION_NONE;
+  iClassErrorCode rc = ActivateAll();
+  if (ICLASS_EC_OK != rc) return rc;
+  rc = Identify(csn);
+  if (ICLASS_EC_OK != rc) return rc;
+  rc = Select(csn);
+  if (ICLASS_EC_OK != rc) return rc;
+  for (int i=0; i<8; i++) sessionCSN[i] = csn[i];
+  sessionState = ICLASS_SESSION_SELECTED;
+
+  if (computeMac) {
+    uint8_t ccnr[8];
+    uint8_t mac[4];
+    rc = ReadCheck(ccnr);
+    if (ICLASS_EC_OK == rc) {
+      computeMac(csn, ccnr, mac);
+      rc = Check(mac);
+    }
+    if (ICLASS_EC_OK != rc) {
+      sessionState = ICLASS_SESSION_NONE;
+      return rc;
+    }
+    sessionState = ICLASS_SESSION_AUTHENTICATED;
+  }
+  return ICLASS_EC_OK;
+}
+
+/*
+ * Read numBlocks blocks, starting at firstBlock, of the card of the open session,
+ * four blocks per READ4 command. If a command fails, the session is closed.
+ *
+ * blockData : receives 8 * numBlocks bytes
+ */
+iClassErrorCode PN5180iClass::ReadBlocks(uint8_t firstBlock, uint8_t numBlocks, uint8_t *blockData) {
+  if (ICLASS_SESSION_NONE == sessionState) {
+    return ICLASS_EC_NO_CARD;
+  }
+
+  uint8_t data[32];
+  uint16_t done = 0;
+  while (done < numBlocks) {
+    iClassErrorCode rc = Read4(firstBlock + done, data);
+    if (ICLASS_EC_OK != rc) {
+      sessionState = ICLASS_SESSION_NONE;
+      return rc;
+    }
+    uint8_t n = (numBlocks - done < 4) ? (numBlocks - done) : 4;
+    for (int i=0; i<8*n; i++) {
+      blockData[8*done + i] = data[i];
+    }
+    done += n;
+  }
+  return ICLASS_EC_OK;
+}
+
+void PN5180iClass::Close() {
+  if (ICLASS_SESSION_NONE != sessionState) {
+    Halt();
+  }
+  sessionState = ICLASS_SESSION_NONE;
+}
+
+iClassErrorCode PN5180iClass::issueiClassCommand(uint8_t *cmd, uint8_t cmdLen, uint8_t **resultPtr, uint16_t *resultLen) {
 #ifdef DEBUG
   PN5180DEBUG(F("Issue Command 0x"));
   PN5180DEBUG(formatHex(cmd[1]));
   PN5180DEBUG("...\n");
 #endif
 
+  clearIRQStatus(RX_SOF_DET_IRQ_STAT | IDLE_IRQ_STAT | TX_IRQ_STAT | RX_IRQ_STAT);
   sendData(cmd, cmdLen);
-  delay(10);
+
+  // wait for the end of reception, the card answers within ICLASS_RESPONSE_TIMEOUT
+  uint32_t start = millis();
+  while (0 == (getIRQStatus() & RX_IRQ_STAT)) {
+    if ((uint32_t)(millis() - start) > ICLASS_RESPONSE_TIMEOUT) break;
+  }
 
   if (0 == (getIRQStatus() & RX_SOF_DET_IRQ_STAT)) {
-    return EC_NO_CARD;
+    return ICLASS_EC_NO_CARD;
   }
 
   uint32_t rxStatus;
@@ -201,6 +333,7 @@ iClassErrorCode PN5180iClass::issueiClassCommand(uint8_t *cmd, uint8_t cmdLen, u
   PN5180DEBUG(formatHex(rxStatus));
 
   uint16_t len = (uint16_t)(rxStatus & 0x000001ff);
+  if (resultLen) *resultLen = len;
 
   PN5180DEBUG(", len=");
   PN5180DEBUG(len);
@@ -224,7 +357,7 @@ iClassErrorCode PN5180iClass::issueiClassCommand(uint8_t *cmd, uint8_t cmdLen, u
   uint32_t irqStatus = getIRQStatus();
   if (0 == (RX_SOF_DET_IRQ_STAT & irqStatus)) { // no card detected
      clearIRQStatus(TX_IRQ_STAT | IDLE_IRQ_STAT);
-     return EC_NO_CARD;
+     return ICLASS_EC_NO_CARD;
   }
 
   // Datasheet Picopass 2K V1.0  section 4.3.2
@@ -257,6 +390,7 @@ iClassErrorCode PN5180iClass::issueiClassCommand(uint8_t *cmd, uint8_t cmdLen, u
 }
 
 bool PN5180iClass::setupRF() {
+  sessionState = ICLASS_SESSION_NONE;
   PN5180DEBUG(F("Loading RF-Configuration...\n"));
   if (loadRFConfig(0x0d, 0x8d)) {  // ISO15693 parameters
     PN5180DEBUG(F("done.\n"));
@@ -269,19 +403,27 @@ bool PN5180iClass::setupRF() {
   }
   else return false;
 
-  writeRegisterWithAndMask(SYSTEM_CONFIG, 0xfffffff8);  // Idle/StopCom Command
-  writeRegisterWithOrMask(SYSTEM_CONFIG, 0x00000003);   // Transceive Command
+  writeRegisterWithAndMask(SYSTEM_CONFIG, ~SYSTEM_CONFIG_COMMAND_MASK);  // Idle/StopCom Command
+  writeRegisterWithOrMask(SYSTEM_CONFIG, SYSTEM_CONFIG_TRANSCEIVE);     // Transceive Command
 
   return true;
 }
 
+/*
+ * Switch to iClass with the RF field already on, e.g. after another protocol was used
+ */
+bool PN5180iClass::loadProtocolConfig() {
+  sessionState = ICLASS_SESSION_NONE;
+  return applyProfile(PN5180_PROFILE_ICLASS);
+}
+
 const __FlashStringHelper *PN5180iClass::strerror(iClassErrorCode errno) {
   PN5180DEBUG(F("iClassErrorCode="));
   PN5180DEBUG(errno);
   PN5180DEBUG("\n");
 
   switch (errno) {
-    case EC_NO_CARD: return F("No card detected!");
+    case ICLASS_EC_NO_CARD: return F("No card detected!");
     case ICLASS_EC_OK: return F("OK!");
     default:
       return F("Undefined error code in iClass!");
@@ -29,21 +29,38 @@ enum {
   ICLASS_CMD_READCHECK = 0x88,
   ICLASS_CMD_CHECK = 0x05,
   ICLASS_CMD_READ = 0x0C,
+  ICLASS_CMD_READ4 = 0x06,
 };
 
+// Max. time to wait for the response of a card in milliseconds
+#define ICLASS_RESPONSE_TIMEOUT  (10)
+
 enum iClassErrorCode {
-  EC_NO_CARD = -1,
+  ICLASS_EC_NO_CARD = -1,
   ICLASS_EC_OK = 0,
   ICLASS_EC_UNKNOWN_ERROR = 0xFE,
 };
 
+// Computes the 4 byte MAC for CHECK from CSN and CCNR of the card
+typedef void (*iClassMacFunction)(const uint8_t *csn, const uint8_t *ccnr, uint8_t *mac);
+
+enum iClassSessionState {
+  ICLASS_SESSION_NONE = 0,
+  ICLASS_SESSION_SELECTED = 1,
+  ICLASS_SESSION_AUTHENTICATED = 2
+};
+
 class PN5180iClass : public PN5180 {
 
 public:
   PN5180iClass(uint8_t SSpin, uint8_t BUSYpin, uint8_t RSTpin);
 
 private:
-  iClassErrorCode issueiClassCommand(uint8_t *cmd, uint8_t cmdLen, uint8_t **resultPtr);
+  // card selected with Select, and authenticated, if ReadCheck/Check succeeded
+  iClassSessionState sessionState;
+  uint8_t sessionCSN[8];
+
+  iClassErrorCode issueiClassCommand(uint8_t *cmd, uint8_t cmdLen, uint8_t **resultPtr, uint16_t *resultLen = NULL);
 public:
   iClassErrorCode ActivateAll();
   iClassErrorCode Identify(uint8_t *csn);
@@ -51,13 +68,20 @@ public:
   iClassErrorCode ReadCheck(uint8_t *ccnr);
   iClassErrorCode Check(uint8_t *mac);
   iClassErrorCode Read(uint8_t blockNum, uint8_t *blockData);
+  iClassErrorCode Read4(uint8_t blockNum, uint8_t *blockData);
   iClassErrorCode Halt();
+  // Session with a selected card
+  iClassErrorCode Open(uint8_t *csn, iClassMacFunction computeMac = NULL);
+  iClassErrorCode ReadBlocks(uint8_t firstBlock, uint8_t numBlocks, uint8_t *blockData);
+  void Close();
+  iClassSessionState getSessionState() { return sessionState; }
 
   /*
    * Helper functions
    */
 public:
   bool setupRF();
+  bool loadProtocolConfig();
   const __FlashStringHelper *strerror(iClassErrorCode errno);
 
 };
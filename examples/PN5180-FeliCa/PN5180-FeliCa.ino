@@ -157,9 +157,7 @@ void loop() {
     Serial.println("Free heap: " + String(ESP.getFreeHeap())); 
   #endif
   uint8_t uid[20];
-  // check for FeliCa card
-  nfc.reset();
-  nfc.setupRF();
+  // check for FeliCa card, the RF field stays on between polls
   uint8_t uidLength = nfc.readCardSerial(uid);
   if (uidLength > 0) {
     Serial.print(F("FeliCa card found, UID="));